@@ -1,45 +1,336 @@
 #include "fft.hpp"
 
 #include <fftw3.h>
+#include <sys/mman.h>
 
+#include <atomic>
+#include <filesystem>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <thread>
+#include <utility>
+#include <vector>
 
 static_assert(sizeof(std::complex<double>) == sizeof(fftw_complex),
     "incompatible std::complex implementation");
+static_assert(sizeof(std::complex<float>) == sizeof(fftwf_complex),
+    "incompatible std::complex implementation");
 
 using namespace std;
 
+namespace {
+// the FFTW planner and wisdom functions are not thread-safe
+mutex planner_mutex;
+
+atomic<size_t> allocated_bytes{0};
+
+// buffers from this size are mapped directly and backed by huge pages
+constexpr size_t huge_page = size_t(2) << 20u;
+
+// round up to an eighth of the leading power of two, or to huge pages, so
+// that buffers of similar sizes share a bucket at under 1/8 of waste
+size_t bucket_size(const size_t bytes) {
+    size_t step = 64;
+    while (step * 16 <= bytes) { step *= 2; }
+    if (bytes >= huge_page) { step = max(step, huge_page); }
+    return (bytes + step - 1) / step * step;
+}
+
+void *allocate(const size_t bytes) {
+    if (bytes < huge_page) {
+        const auto p = fftw_malloc(bytes);
+        if (p == nullptr) { throw bad_alloc(); }
+        return p;
+    }
+    const auto p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) { throw bad_alloc(); }
+#ifdef MADV_HUGEPAGE
+    ::madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+void deallocate(void *p, const size_t bytes) {
+    if (bytes < huge_page) {
+        fftw_free(p);
+    } else {
+        ::munmap(p, bytes);
+    }
+}
+
+// Released buffers are kept by bucket for the next new_buffer, as long as
+// the live and idle buffers together stay within the peak of the live ones,
+// so pooling never takes more memory than the process needed before.
+class buffer_pool final {
+    mutex mu;
+    list<pair<size_t, void *>> idle; // least recently released first
+    size_t idle_bytes = 0, live_bytes = 0, peak_bytes = 0;
+
+public:
+    void *get(const size_t bytes) {
+        {
+            lock_guard<mutex> lock(mu);
+            live_bytes += bytes;
+            peak_bytes = max(peak_bytes, live_bytes);
+            for (auto it = idle.rbegin(); it != idle.rend(); ++it) {
+                if (it->first == bytes) {
+                    const auto p = it->second;
+                    idle.erase(next(it).base());
+                    idle_bytes -= bytes;
+                    return p;
+                }
+            }
+        }
+        try {
+            return allocate(bytes);
+        } catch (...) {
+            lock_guard<mutex> lock(mu);
+            live_bytes -= bytes;
+            throw;
+        }
+    }
+
+    void put(void *const p, const size_t bytes) {
+        vector<pair<size_t, void *>> evicted;
+        {
+            lock_guard<mutex> lock(mu);
+            live_bytes -= bytes;
+            const auto room = peak_bytes - live_bytes;
+            while (!idle.empty() && idle_bytes + bytes > room) {
+                evicted.push_back(idle.front());
+                idle_bytes -= idle.front().first;
+                idle.pop_front();
+            }
+            if (idle_bytes + bytes <= room) {
+                idle.emplace_back(bytes, p);
+                idle_bytes += bytes;
+            } else {
+                evicted.emplace_back(bytes, p);
+            }
+        }
+        for (const auto &[size, q] : evicted) {
+            deallocate(q, size);
+        }
+    }
+
+    void clear() {
+        list<pair<size_t, void *>> evicted;
+        {
+            lock_guard<mutex> lock(mu);
+            evicted.swap(idle);
+            idle_bytes = 0;
+            peak_bytes = live_bytes;
+        }
+        for (const auto &[size, q] : evicted) {
+            deallocate(q, size);
+        }
+    }
+};
+
+// never destroyed, buffers may be released during static destruction
+buffer_pool &pool() {
+    static auto *const p = new buffer_pool;
+    return *p;
+}
+
+unsigned planner_flags(const planner_type planner) {
+    switch (planner) {
+    case planner_type::estimate: return FFTW_ESTIMATE;
+    case planner_type::measure: return FFTW_MEASURE;
+    case planner_type::patient: return FFTW_PATIENT;
+    }
+    return FFTW_ESTIMATE;
+}
+
+template<typename T>
+struct fftw;
+
+#define FFTW_TRAITS(T, X)                                                      \
+    template<>                                                                 \
+    struct fftw<T> {                                                           \
+        using complex = X##_complex;                                           \
+        using plan = X##_plan;                                                 \
+        static constexpr auto alloc_complex = X##_alloc_complex;               \
+        static constexpr auto free = X##_free;                                 \
+        static constexpr auto plan_r2c_2d = X##_plan_dft_r2c_2d;               \
+        static constexpr auto plan_c2r_2d = X##_plan_dft_c2r_2d;               \
+        static constexpr auto plan_many_dft = X##_plan_many_dft;               \
+        static constexpr auto plan_many_r2c = X##_plan_many_dft_r2c;           \
+        static constexpr auto plan_many_c2r = X##_plan_many_dft_c2r;           \
+        static constexpr auto execute_dft = X##_execute_dft;                   \
+        static constexpr auto execute_r2c = X##_execute_dft_r2c;               \
+        static constexpr auto execute_c2r = X##_execute_dft_c2r;               \
+        static constexpr auto destroy_plan = X##_destroy_plan;                 \
+        static constexpr auto flops = X##_flops;                               \
+        static constexpr auto import_wisdom = X##_import_wisdom_from_filename; \
+        static constexpr auto export_wisdom = X##_export_wisdom_to_filename;   \
+        static constexpr auto init_threads = X##_init_threads;                 \
+        static constexpr auto plan_with_nthreads = X##_plan_with_nthreads;     \
+        static constexpr auto cleanup = X##_cleanup_threads;                   \
+        static inline bool threads_ready = false;                              \
+    }
+
+FFTW_TRAITS(float, fftwf);
+FFTW_TRAITS(double, fftw);
+
+#undef FFTW_TRAITS
+} // namespace
+
+template<typename T>
 struct fft_private {
-    fftw_plan plan;
+    typename fftw<T>::plan plan;
+    // the column pass of a pruned backward transform, plan then does the rows
+    typename fftw<T>::plan columns_plan;
+    const bool backward;
 
-    explicit fft_private(
-        const size_t width, const size_t height, bool backward) {
-        const auto sign = backward ? FFTW_BACKWARD : FFTW_FORWARD;
-        const auto buf = fftw_alloc_complex(width * height);
-        plan = ::fftw_plan_dft_2d(static_cast<int>(height),
-            static_cast<int>(width), buf, buf, sign, FFTW_ESTIMATE);
-        fftw_free(buf);
+    explicit fft_private(const size_t width, const size_t height,
+        bool backward, const planner_type planner, const unsigned threads,
+        const size_t columns, const size_t batch)
+        : columns_plan(nullptr), backward(backward) {
+        const auto n0 = static_cast<int>(height);
+        const auto n1 = static_cast<int>(width);
+        const auto flags = planner_flags(planner);
+        lock_guard<mutex> lock(planner_mutex);
+        if (!fftw<T>::threads_ready) {
+            fftw<T>::threads_ready = fftw<T>::init_threads() != 0;
+        }
+        if (fftw<T>::threads_ready) {
+            fftw<T>::plan_with_nthreads(static_cast<int>(threads));
+        }
+        // measuring planners overwrite the buffer, so plan on a scratch one
+        const auto n = fft<T>::buffer_size(width, height);
+        const auto buf = fftw<T>::alloc_complex(n * batch);
+        const auto real = reinterpret_cast<T *>(buf);
+        const auto cw = static_cast<int>(fft<T>::spectrum_width(width));
+        if (batch > 1) {
+            // planes of n coefficients one after another, transformed in place
+            const int dims[] = {n0, n1};
+            const int real_dims[] = {n0, cw * 2}, complex_dims[] = {n0, cw};
+            const auto howmany = static_cast<int>(batch);
+            const auto dist = static_cast<int>(n);
+            if (backward) {
+                plan = fftw<T>::plan_many_c2r(2, dims, howmany, buf,
+                    complex_dims, 1, dist, real, real_dims, 1, dist * 2,
+                    flags);
+            } else {
+                plan = fftw<T>::plan_many_r2c(2, dims, howmany, real,
+                    real_dims, 1, dist * 2, buf, complex_dims, 1, dist, flags);
+            }
+        } else if (backward && columns > 0 && static_cast<int>(columns) < cw) {
+            // the columns past the given ones are zero and stay zero through
+            // the column transforms, so only the rows see them
+            columns_plan = fftw<T>::plan_many_dft(1, &n0,
+                static_cast<int>(columns), buf, nullptr, cw, 1, buf, nullptr,
+                cw, 1, FFTW_BACKWARD, flags);
+            plan = fftw<T>::plan_many_c2r(1, &n1, n0, buf, nullptr, 1, cw,
+                real, nullptr, 1, cw * 2, flags);
+        } else if (backward) {
+            plan = fftw<T>::plan_c2r_2d(n0, n1, buf, real, flags);
+        } else {
+            plan = fftw<T>::plan_r2c_2d(n0, n1, real, buf, flags);
+        }
+        fftw<T>::free(buf);
     }
 
-    ~fft_private() { fftw_destroy_plan(plan); }
+    ~fft_private() {
+        lock_guard<mutex> lock(planner_mutex);
+        if (columns_plan != nullptr) { fftw<T>::destroy_plan(columns_plan); }
+        fftw<T>::destroy_plan(plan);
+    }
 };
 
-fft::fft(const size_t width, const size_t height, bool backward)
-    : p(make_unique<fft_private>(width, height, backward)) {}
+template<typename T>
+fft<T>::fft(const size_t width, const size_t height, bool backward,
+    const planner_type planner, const unsigned threads, const size_t columns,
+    const size_t batch)
+    : p(make_unique<fft_private<T>>(
+          width, height, backward, planner, threads, columns, batch)) {}
+
+template<typename T>
+fft<T>::~fft() = default;
+
+template<typename T>
+void fft<T>::compute(std::shared_ptr<std::complex<T>> buf) {
+    const auto c = reinterpret_cast<typename fftw<T>::complex *>(buf.get());
+    const auto r = reinterpret_cast<T *>(buf.get());
+    if (p->columns_plan != nullptr) {
+        fftw<T>::execute_dft(p->columns_plan, c, c);
+        fftw<T>::execute_c2r(p->plan, c, r);
+    } else if (p->backward) {
+        fftw<T>::execute_c2r(p->plan, c, r);
+    } else {
+        fftw<T>::execute_r2c(p->plan, r, c);
+    }
+}
+
+template<typename T>
+double fft<T>::flops() const {
+    double sum = 0.0;
+    for (const auto plan : {p->plan, p->columns_plan}) {
+        if (plan == nullptr) { continue; }
+        double add, mul, fma;
+        fftw<T>::flops(plan, &add, &mul, &fma);
+        sum += add + mul + 2.0 * fma;
+    }
+    return sum;
+}
+
+template<typename T>
+size_t fft<T>::good_size(size_t n) {
+    for (;; n++) {
+        auto m = n;
+        for (const size_t f : {2, 3, 5, 7}) {
+            while (m % f == 0) { m /= f; }
+        }
+        if (m <= 1) { return n; }
+    }
+}
+
+template<typename T>
+shared_ptr<complex<T>> fft<T>::new_buffer(size_t n) {
+    const auto bytes = bucket_size(n * sizeof(complex<T>));
+    const auto p = static_cast<complex<T> *>(pool().get(bytes));
+    allocated_bytes += n * sizeof(complex<T>);
+    return shared_ptr<complex<T>>{
+        p, [bytes](complex<T> *p) { pool().put(p, bytes); }};
+}
+
+template<typename T>
+size_t fft<T>::allocated() {
+    return allocated_bytes;
+}
 
-fft::~fft() = default;
+template<typename T>
+T *fft<T>::real(const shared_ptr<complex<T>> &buf) {
+    return reinterpret_cast<T *>(buf.get());
+}
+
+template<typename T>
+bool fft<T>::import_wisdom(const string &filename) {
+    lock_guard<mutex> lock(planner_mutex);
+    return fftw<T>::import_wisdom(filename.c_str()) != 0;
+}
 
-void fft::compute(std::shared_ptr<std::complex<double>> buf) {
-    const auto b = reinterpret_cast<fftw_complex *>(buf.get());
-    fftw_execute_dft(p->plan, b, b);
+template<typename T>
+bool fft<T>::export_wisdom(const string &filename) {
+    lock_guard<mutex> lock(planner_mutex);
+    error_code ec;
+    const auto dir = filesystem::path(filename).parent_path();
+    if (!dir.empty()) { filesystem::create_directories(dir, ec); }
+    if (ec) { return false; }
+    return fftw<T>::export_wisdom(filename.c_str()) != 0;
 }
 
-shared_ptr<complex<double>> fft::new_buffer(size_t n) {
-    static const auto deleter = [](auto p) { ::fftw_free(p); };
-    const auto p = reinterpret_cast<complex<double> *>(::fftw_alloc_complex(n));
-    return shared_ptr<complex<double>>{p, deleter};
+template<typename T>
+void fft<T>::cleanup() {
+    pool().clear();
+    lock_guard<mutex> lock(planner_mutex);
+    fftw<T>::cleanup();
+    fftw<T>::threads_ready = false;
 }
 
-void fft::cleanup() { fftw_cleanup(); }
+template class fft<float>;
+template class fft<double>;
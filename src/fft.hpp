@@ -1,25 +1,69 @@
 #ifndef IMAGECONV_FFT_HPP
 #define IMAGECONV_FFT_HPP
 
+#include "options.hpp"
+
 #include <complex>
 #include <memory>
 #include <stack>
+#include <string>
 #include <vector>
 
+template<typename T>
 struct fft_private;
 
+// fft transforms real planes in place: forward is r2c, backward is c2r.
+// A width*height real plane is stored with row stride real_stride(width)
+// and its spectrum keeps only the non-redundant spectrum_width(width)
+// columns of the Hermitian half. T is either float (fftw3f) or double
+// (fftw3).
+template<typename T>
 class fft final {
-    std::unique_ptr<struct fft_private> p;
+    std::unique_ptr<struct fft_private<T>> p;
 
 public:
-    fft(std::size_t width, std::size_t height, bool backward = false);
+    // A backward transform given columns > 0 assumes that only the first
+    // columns of each spectrum row are non-zero and skips the column
+    // transforms of the rest. With batch > 1, the buffer holds batch planes
+    // of buffer_size(width, height) one after another, all transformed by
+    // one call; columns is then ignored.
+    fft(std::size_t width, std::size_t height, bool backward = false,
+        planner_type planner = planner_type::estimate, unsigned threads = 1,
+        std::size_t columns = 0, std::size_t batch = 1);
 
     ~fft();
 
-    void compute(std::shared_ptr<std::complex<double>>);
+    void compute(std::shared_ptr<std::complex<T>>);
+
+    // FFTW's count of the floating-point operations of one transform
+    [[nodiscard]] double flops() const;
+
+    static std::size_t spectrum_width(std::size_t width) {
+        return width / 2 + 1;
+    }
+    static std::size_t real_stride(std::size_t width) {
+        return spectrum_width(width) * 2;
+    }
+    static std::size_t buffer_size(std::size_t width, std::size_t height) {
+        return spectrum_width(width) * height;
+    }
 
-    static std::shared_ptr<std::complex<double>> new_buffer(std::size_t);
+    // smallest size >= n with no prime factors other than 2, 3, 5 and 7
+    static std::size_t good_size(std::size_t n);
+
+    // Buffers are SIMD-aligned and uninitialized. Released ones go back to
+    // a pool shared by both precisions and are handed out again by later
+    // calls; cleanup() empties the pool.
+    static std::shared_ptr<std::complex<T>> new_buffer(std::size_t);
+    // bytes allocated by new_buffer so far, in either precision
+    static std::size_t allocated();
+    static T *real(const std::shared_ptr<std::complex<T>> &);
+    static bool import_wisdom(const std::string &filename);
+    static bool export_wisdom(const std::string &filename);
     static void cleanup();
 };
 
+extern template class fft<float>;
+extern template class fft<double>;
+
 #endif // IMAGECONV_FFT_HPP
@@ -1,47 +1,322 @@
 #include "image.hpp"
+#include "planes.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <array>
 #include <cmath>
-#include <complex>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include <boost/gil.hpp>
 #include <boost/gil/extension/io/png.hpp>
+#include <png.h>
+
+namespace {
+// a libpng reader left at the first row of the file
+class png_stream final {
+    const std::string path;
+    std::FILE *file;
+    png_structp png;
+    png_infop info;
+
+    [[noreturn]] void fail() const {
+        throw std::runtime_error("failed to read png file: " + path);
+    }
+
+public:
+    std::size_t width, height;
+    double gamma;
+    bool rgb8; // 8-bit RGB rows in storage order
+
+    explicit png_stream(std::string filename)
+        : path(std::move(filename)), file(std::fopen(path.c_str(), "rb")),
+          png(nullptr), info(nullptr), width(0), height(0), gamma(1.0),
+          rgb8(false) {
+        if (file == nullptr) { fail(); }
+        png = png_create_read_struct(
+            PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        if (png != nullptr) { info = png_create_info_struct(png); }
+        if (info == nullptr || setjmp(png_jmpbuf(png))) {
+            close();
+            fail();
+        }
+        png_init_io(png, file);
+        png_read_info(png, info);
+        width = png_get_image_width(png, info);
+        height = png_get_image_height(png, info);
+        rgb8 = png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB &&
+               png_get_bit_depth(png, info) == 8 &&
+               png_get_interlace_type(png, info) == PNG_INTERLACE_NONE;
+        if (!png_get_gAMA(png, info, &gamma)) { gamma = 1.0; }
+    }
+
+    png_stream(const png_stream &) = delete;
+    png_stream &operator=(const png_stream &) = delete;
+
+    ~png_stream() { close(); }
+
+    void close() {
+        if (png != nullptr) {
+            png_destroy_read_struct(&png, info != nullptr ? &info : nullptr,
+                nullptr);
+        }
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
 
+    void read_row(unsigned char *row) {
+        if (setjmp(png_jmpbuf(png))) { fail(); }
+        png_read_row(png, row, nullptr);
+    }
+};
+
+constexpr char raw_magic[8] = {'I', 'C', 'P', 'L', 'A', 'N', 'A', 'R'};
+constexpr std::uint32_t raw_version = 1;
+
+// the header is padded so that the planes stay aligned for SIMD loads
+struct alignas(64) raw_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t elem_size;
+    std::uint64_t width, height;
+};
+static_assert(sizeof(raw_header) == 64, "unexpected header size");
+
+// A raw file mapped into memory: the header, then the red, green and blue
+// planes of width*height linear floats or doubles each, row by row. A new
+// file is filled in place under a temporary name and renamed on commit.
+class raw_file final {
+    const std::string path;
+    std::string tmp; // the name of a new file until it is committed
+    void *addr;
+    std::size_t length;
+
+    [[noreturn]] void fail(const char *what) const {
+        throw std::runtime_error(
+            std::string("failed to ") + what + " raw file: " + path);
+    }
+
+    void map(const int fd, const int prot) {
+        addr = ::mmap(nullptr, length, prot, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            addr = nullptr;
+            fail("map");
+        }
+    }
+
+public:
+    std::size_t width, height, elem_size;
+
+    explicit raw_file(std::string filename)
+        : path(std::move(filename)), addr(nullptr), length(0), width(0),
+          height(0), elem_size(0) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { fail("read"); }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 ||
+            static_cast<std::size_t>(st.st_size) < sizeof(raw_header)) {
+            ::close(fd);
+            fail("read");
+        }
+        length = st.st_size;
+        map(fd, PROT_READ);
+        // the planes are read through once, or in tiles in any order
+        ::madvise(addr, length, MADV_WILLNEED);
+        const auto hdr = static_cast<const raw_header *>(addr);
+        width = hdr->width;
+        height = hdr->height;
+        elem_size = hdr->elem_size;
+        // the planes must fill the file exactly; the header is not trusted,
+        // so its sizes are checked against the length before multiplying
+        const auto data = length - sizeof(raw_header);
+        const auto pixel = 3 * elem_size;
+        if (std::memcmp(hdr->magic, raw_magic, sizeof(raw_magic)) != 0 ||
+            hdr->version != raw_version ||
+            (elem_size != sizeof(float) && elem_size != sizeof(double)) ||
+            width == 0 || height == 0 || width > data / pixel / height ||
+            data != width * height * pixel) {
+            ::munmap(addr, length);
+            addr = nullptr;
+            fail("read");
+        }
+    }
+
+    raw_file(std::string filename, const std::size_t width,
+        const std::size_t height, const std::size_t elem_size)
+        : path(std::move(filename)), tmp(path + ".tmp.XXXXXX"),
+          addr(nullptr),
+          length(sizeof(raw_header) + width * height * 3 * elem_size),
+          width(width), height(height), elem_size(elem_size) {
+        // a name of its own, as the same output may be written concurrently
+        const int fd = ::mkostemp(tmp.data(), O_CLOEXEC);
+        if (fd < 0) {
+            tmp.clear();
+            fail("write");
+        }
+        ::fchmod(fd, 0644);
+        // reserve the blocks now, a full disk would fault in the saves
+        if (::posix_fallocate(fd, 0, static_cast<off_t>(length)) != 0) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            fail("write");
+        }
+        try {
+            map(fd, PROT_READ | PROT_WRITE);
+        } catch (...) {
+            ::unlink(tmp.c_str());
+            throw;
+        }
+        raw_header hdr{};
+        std::memcpy(hdr.magic, raw_magic, sizeof(raw_magic));
+        hdr.version = raw_version;
+        hdr.elem_size = static_cast<std::uint32_t>(elem_size);
+        hdr.width = width;
+        hdr.height = height;
+        std::memcpy(addr, &hdr, sizeof(hdr));
+    }
+
+    raw_file(const raw_file &) = delete;
+    raw_file &operator=(const raw_file &) = delete;
+
+    ~raw_file() {
+        if (addr != nullptr) { ::munmap(addr, length); }
+        if (!tmp.empty()) { ::unlink(tmp.c_str()); }
+    }
+
+    template<typename U>
+    U *plane(const int channel) const {
+        const auto data = static_cast<char *>(addr) + sizeof(raw_header);
+        return reinterpret_cast<U *>(data) + width * height * channel;
+    }
+
+    // unmap a new file and move it into place
+    void commit() {
+        if (::munmap(addr, length) != 0) { fail("write"); }
+        addr = nullptr;
+        if (::rename(tmp.c_str(), path.c_str()) != 0) { fail("write"); }
+        tmp.clear();
+    }
+};
+
+bool is_raw(const std::string &filename) {
+    return std::filesystem::path(filename).extension() == ".raw";
+}
+} // namespace
+
+// Unless asked to decode, only the header is read on construction and the
+// first load streams the rows from the file, or stream_rows keeps a band of
+// them for the regions. Formats that need conversion are decoded by gil up
+// front instead. Raw files are mapped rather than decoded, and hold the
+// values of the planes as they are. A banded output holds rows from top on
+// in image and hands them to sink.
 struct image_private {
     boost::gil::rgb8_image_t image;
-    const double gamma;
+    std::unique_ptr<png_stream> stream;
+    std::vector<unsigned char> band; // 8-bit rows streamed from first on
+    std::size_t first = 0;
+    std::unique_ptr<png_band_writer> sink;
+    std::size_t top = 0;
+    std::unique_ptr<raw_file> raw;
+    std::size_t width, height;
+    double gamma;
 
-    explicit image_private(const std::string &path)
-        : gamma(boost::gil::read_image_info(path, boost::gil::png_tag{})
-                    ._info._file_gamma) {
-        boost::gil::read_image(path, image, boost::gil::png_tag{});
+    image_private(const std::string &path, const bool decode)
+        : width(0), height(0), gamma(0.0) {
+        if (is_raw(path)) {
+            raw = std::make_unique<raw_file>(path);
+            width = raw->width;
+            height = raw->height;
+            return;
+        }
+        stream = std::make_unique<png_stream>(path);
+        width = stream->width;
+        height = stream->height;
+        gamma = stream->gamma;
+        if (decode || !stream->rgb8) {
+            stream = nullptr;
+            boost::gil::read_image(path, image, boost::gil::png_tag{});
+        }
     }
 
     explicit image_private(
         const std::size_t width, const std::size_t height, const double gamma)
-        : image(width, height), gamma(gamma) {}
+        : image(width, height), width(width), height(height), gamma(gamma) {}
+
+    image_private(const std::string &path, const std::size_t width,
+        const std::size_t height, const std::size_t elem_size)
+        : raw(std::make_unique<raw_file>(path, width, height, elem_size)),
+          width(width), height(height), gamma(0.0) {}
+
+    image_private(const std::string &path, const std::size_t width,
+        const std::size_t height, const std::size_t rows,
+        const png_writer &writer, const double gamma)
+        : image(width, std::min(rows, height)),
+          sink(std::make_unique<png_band_writer>(
+              path, writer, width, height)),
+          width(width), height(height), gamma(gamma) {}
+
+    const boost::gil::rgb8_image_t &pixels() const {
+        if (stream || static_cast<std::size_t>(image.width()) != width) {
+            throw std::logic_error("image pixels are not decoded");
+        }
+        return image;
+    }
 };
 
-image::image(const std::string &filename)
-    : p(std::make_unique<image_private>(filename)),
+image::image(const std::string &filename, const bool decode)
+    : p(std::make_unique<image_private>(filename, decode)),
       gamma(p->gamma > 0.0 ? p->gamma : default_gamma) {}
 
 image::image(const std::size_t width, const std::size_t height)
     : p(std::make_unique<image_private>(width, height, default_gamma)),
       gamma(default_gamma) {}
 
+image::image(const std::string &filename, const std::size_t width,
+    const std::size_t height, const precision_type precision)
+    : p(is_raw(filename)
+            ? std::make_unique<image_private>(filename, width, height,
+                  precision == precision_type::float32 ? sizeof(float)
+                                                       : sizeof(double))
+            : std::make_unique<image_private>(width, height, default_gamma)),
+      gamma(default_gamma) {}
+
+image::image(const std::string &filename, const std::size_t width,
+    const std::size_t height, const precision_type precision,
+    const png_writer &writer, const std::size_t rows)
+    : p(is_raw(filename)
+            ? std::make_unique<image_private>(filename, width, height,
+                  precision == precision_type::float32 ? sizeof(float)
+                                                       : sizeof(double))
+            : std::make_unique<image_private>(
+                  filename, width, height, rows, writer, default_gamma)),
+      gamma(default_gamma) {}
+
 image::~image() = default;
 
 std::tuple<std::size_t, std::size_t> image::get_size() const {
-    const auto &image = p->image;
-    return {image.width(), image.height()};
+    return {p->width, p->height};
 }
 
 std::tuple<std::size_t, std::size_t> image::get_extended_size(
     const unsigned px) const {
-    const auto &image = p->image;
-    return {image.width() + px * 2, image.height() + px * 2};
+    return {p->width + px * 2, p->height + px * 2};
 }
 
 namespace {
@@ -58,64 +333,220 @@ public:
     inline double operator()(const unsigned char b) const { return table[b]; }
 };
 
+// Encodes c as floor(255 * pow(c, gamma)) clamped to [0, 255], bit-exact,
+// without calling pow per pixel: table[k] is the least c that encodes to k
+// or more, and the code is found by a branchless binary search.
 class color_encoder final {
-    const double gamma;
-
-public:
-    explicit color_encoder(const double encode_gamma) : gamma(encode_gamma) {}
+    double table[256];
 
-    inline unsigned char operator()(const std::complex<double> &c) const {
-        double v = std::pow(c.real(), gamma);
+    static unsigned char exact(const double c, const double gamma) {
+        double v = std::pow(c, gamma);
         if (v <= 0.0) { return 0u; }
         v *= 255.0;
         if (v >= 255.0) { return 255u; }
         return static_cast<unsigned char>(v);
     }
+
+public:
+    explicit color_encoder(const double encode_gamma) {
+        constexpr auto inf = std::numeric_limits<double>::infinity();
+        table[0] = -inf;
+        for (int k = 1; k < 256; k++) {
+            // start next to the threshold and walk it to the exact one
+            auto c = std::pow(k / 255.0, 1.0 / encode_gamma);
+            while (exact(c, encode_gamma) >= k) {
+                c = std::nextafter(c, -inf);
+            }
+            while (exact(c, encode_gamma) < k) {
+                c = std::nextafter(c, inf);
+            }
+            table[k] = c;
+        }
+    }
+
+    inline unsigned char operator()(const double c) const {
+        unsigned k = 0;
+        for (unsigned step = 128; step > 0; step >>= 1u) {
+            k += c >= table[k + step] ? step : 0;
+        }
+        return static_cast<unsigned char>(k);
+    }
 };
+
+using planes::mirror;
+using planes::parallel_rows;
+
+// the raw planes need no decoding, so the rows inside the image are copied
+// as they are, converted only if the precision differs
+template<typename T, typename U>
+void load_raw(const raw_file &raw, const long x0, const long y0,
+    const std::size_t max_x, const std::size_t max_y, T *const dst[3],
+    const std::size_t stride) {
+    const auto width = static_cast<long>(raw.width);
+    const auto begin = static_cast<std::size_t>(
+        std::clamp(-x0, 0L, static_cast<long>(max_x)));
+    const auto end = static_cast<std::size_t>(std::clamp(
+        width - x0, static_cast<long>(begin), static_cast<long>(max_x)));
+    for (int c = 0; c < 3; c++) {
+        const auto *const src = raw.plane<const U>(c);
+        for (std::size_t y = 0; y < max_y; y++) {
+            const auto *row =
+                src + mirror(y0 + static_cast<long>(y), raw.height) * width;
+            auto *out = dst[c] + y * stride;
+            std::copy(row + x0 + begin, row + x0 + end, out + begin);
+            for (std::size_t x = 0; x < begin; x++) {
+                out[x] = row[mirror(x0 + static_cast<long>(x), raw.width)];
+            }
+            for (auto x = end; x < max_x; x++) {
+                out[x] = row[mirror(x0 + static_cast<long>(x), raw.width)];
+            }
+        }
+    }
+}
+
+template<typename T, typename U>
+void save_raw(raw_file &raw, const std::size_t x0, const std::size_t y0,
+    const std::size_t max_x, const std::size_t max_y, const T *const src[3],
+    const std::size_t stride, const unsigned threads) {
+    parallel_rows(max_y, threads, [&](const std::size_t begin,
+                                      const std::size_t end) {
+        for (int c = 0; c < 3; c++) {
+            auto *const dst = raw.plane<U>(c);
+            for (auto y = begin; y < end; y++) {
+                std::copy_n(src[c] + y * stride, max_x,
+                    dst + (y0 + y) * raw.width + x0);
+            }
+        }
+    });
+}
 } // namespace
 
-void image::load(std::complex<double> *r, std::complex<double> *g,
-    std::complex<double> *b) const {
-    const auto &image = p->image;
-    const std::size_t width = image.width();
-    const std::size_t height = image.height();
+template<typename T>
+void image::load(T *r, T *g, T *b, const std::size_t stride) const {
+    load_extended(0, p->width, p->height, r, g, b, stride);
+}
+
+template<typename T>
+void image::load_extended(const unsigned extend, const std::size_t max_x,
+    const std::size_t max_y, T *r, T *g, T *b,
+    const std::size_t stride) const {
+    if (!p->stream) {
+        const auto offset = -static_cast<long>(extend);
+        load_region(offset, offset, max_x, max_y, r, g, b, stride);
+        return;
+    }
+    const std::size_t width = p->width;
+    const std::size_t height = p->height;
     const color_decoder decode{1.0 / default_gamma};
 
-    const auto view = boost::gil::const_view(image);
+    std::vector<std::size_t> columns(max_x);
+    for (std::size_t x = 0; x < max_x; x++) {
+        const auto ix = static_cast<long>(x) - static_cast<long>(extend);
+        columns[x] = mirror(ix, width) * 3;
+    }
+    std::vector<unsigned char> row(width * 3);
     for (std::size_t y = 0; y < height; y++) {
-        const auto it = view.row_begin(y);
-        for (std::size_t x = 0; x < width; x++) {
-            const auto &pixel = it[x];
-            r[y * width + x] = decode(boost::gil::at_c<0>(pixel));
-            g[y * width + x] = decode(boost::gil::at_c<1>(pixel));
-            b[y * width + x] = decode(boost::gil::at_c<2>(pixel));
+        p->stream->read_row(row.data());
+        const auto i = (y + extend) * stride;
+        for (std::size_t x = 0; x < max_x; x++) {
+            const auto *pixel = &row[columns[x]];
+            r[i + x] = decode(pixel[0]);
+            g[i + x] = decode(pixel[1]);
+            b[i + x] = decode(pixel[2]);
+        }
+    }
+    p->stream = nullptr;
+
+    // the border rows repeat the rows decoded above
+    for (std::size_t y = 0; y < max_y; y++) {
+        const auto iy = static_cast<long>(y) - static_cast<long>(extend);
+        const auto src = mirror(iy, height) + extend;
+        if (src == y) { continue; }
+        std::copy_n(r + src * stride, max_x, r + y * stride);
+        std::copy_n(g + src * stride, max_x, g + y * stride);
+        std::copy_n(b + src * stride, max_x, b + y * stride);
+    }
+}
+
+void image::stream_rows(const long y0, const std::size_t h) {
+    if (!p->stream) { return; }
+    auto lo = p->height, hi = std::size_t(0);
+    for (std::size_t y = 0; y < h; y++) {
+        const auto iy = mirror(y0 + static_cast<long>(y), p->height);
+        lo = std::min(lo, iy);
+        hi = std::max(hi, iy + 1);
+    }
+    if (lo < p->first) {
+        throw std::logic_error("image rows are already dropped");
+    }
+    const auto row_size = p->width * 3;
+    auto held = p->band.size() / row_size;
+    const auto drop = std::min(lo - p->first, held);
+    p->band.erase(p->band.begin(), p->band.begin() + drop * row_size);
+    p->first += drop;
+    held -= drop;
+    std::vector<unsigned char> skipped;
+    while (p->first + held < hi) {
+        if (p->first < lo) {
+            // nothing is held, and no region needs this row
+            skipped.resize(row_size);
+            p->stream->read_row(skipped.data());
+            p->first++;
+            continue;
         }
+        p->band.resize((held + 1) * row_size);
+        p->stream->read_row(p->band.data() + held * row_size);
+        held++;
     }
 }
 
-void image::load_extended(const unsigned extend, std::complex<double> *r,
-    std::complex<double> *g, std::complex<double> *b) const {
-    const auto &image = p->image;
+template<typename T>
+void image::load_region(const long x0, const long y0, const std::size_t max_x,
+    const std::size_t max_y, T *r, T *g, T *b,
+    const std::size_t stride) const {
+    if (p->raw) {
+        T *const planes[] = {r, g, b};
+        if (p->raw->elem_size == sizeof(float)) {
+            load_raw<T, float>(*p->raw, x0, y0, max_x, max_y, planes, stride);
+        } else {
+            load_raw<T, double>(*p->raw, x0, y0, max_x, max_y, planes, stride);
+        }
+        return;
+    }
+    if (p->stream) {
+        const auto width = p->width;
+        const auto held = p->band.size() / (width * 3);
+        const color_decoder decode{1.0 / default_gamma};
+        for (std::size_t y = 0; y < max_y; y++) {
+            const auto iy = mirror(y0 + static_cast<long>(y), p->height);
+            if (iy < p->first || iy >= p->first + held) {
+                throw std::logic_error("image rows are not streamed");
+            }
+            const auto *row = &p->band[(iy - p->first) * width * 3];
+            for (std::size_t x = 0; x < max_x; x++) {
+                const auto *pixel =
+                    row + mirror(x0 + static_cast<long>(x), width) * 3;
+                const auto i = y * stride + x;
+                r[i] = decode(pixel[0]);
+                g[i] = decode(pixel[1]);
+                b[i] = decode(pixel[2]);
+            }
+        }
+        return;
+    }
+    const auto &image = p->pixels();
     const std::size_t width = image.width();
     const std::size_t height = image.height();
     const color_decoder decode{1.0 / default_gamma};
-    const auto max_x = width + extend * 2;
-    const auto max_y = height + extend * 2;
-
-    const auto clamp_i = [extend](const std::size_t i, const std::size_t mx) {
-        if (i < extend) { return extend - i; }
-        if (i < extend + mx) { return i - extend; }
-        return mx * 2 + extend - i - 1;
-    };
 
     const auto view = boost::gil::const_view(image);
     for (std::size_t y = 0; y < max_y; y++) {
-        const auto iy = clamp_i(y, height);
+        const auto iy = mirror(y0 + static_cast<long>(y), height);
         const auto it = view.row_begin(iy);
         for (std::size_t x = 0; x < max_x; x++) {
-            const auto ix = clamp_i(x, width);
+            const auto ix = mirror(x0 + static_cast<long>(x), width);
             const auto &pixel = it[ix];
-            const auto i = y * max_x + x;
+            const auto i = y * stride + x;
             r[i] = decode(boost::gil::at_c<0>(pixel));
             g[i] = decode(boost::gil::at_c<1>(pixel));
             b[i] = decode(boost::gil::at_c<2>(pixel));
@@ -123,49 +554,97 @@ void image::load_extended(const unsigned extend, std::complex<double> *r,
     }
 }
 
-void image::save(const std::complex<double> *r, const std::complex<double> *g,
-    const std::complex<double> *b) {
+template<typename T>
+void image::save(const T *r, const T *g, const T *b, const std::size_t stride,
+    const unsigned threads) {
+    save_region(0, 0, p->width, p->height, r, g, b, stride, threads);
+}
+
+template<typename T>
+void image::save_extended(const unsigned extend, const T *r, const T *g,
+    const T *b, const std::size_t stride, const unsigned threads) {
+    const auto offset = extend * stride + extend;
+    save_region(0, 0, p->width, p->height, r + offset, g + offset,
+        b + offset, stride, threads);
+}
+
+template<typename T>
+void image::save_region(const std::size_t x0, const std::size_t y0,
+    const std::size_t max_x, const std::size_t max_y, const T *r, const T *g,
+    const T *b, const std::size_t stride, const unsigned threads) {
+    if (p->raw) {
+        const T *const planes[] = {r, g, b};
+        if (p->raw->elem_size == sizeof(float)) {
+            save_raw<T, float>(
+                *p->raw, x0, y0, max_x, max_y, planes, stride, threads);
+        } else {
+            save_raw<T, double>(
+                *p->raw, x0, y0, max_x, max_y, planes, stride, threads);
+        }
+        return;
+    }
     auto &image = p->image;
-    const std::size_t width = image.width();
-    const std::size_t height = image.height();
     const color_encoder encode{gamma};
+    if (y0 < p->top ||
+        y0 + max_y > p->top + static_cast<std::size_t>(image.height())) {
+        throw std::logic_error("image rows are not held");
+    }
 
     const auto view = boost::gil::view(image);
-    for (std::size_t y = 0; y < height; y++) {
-        const auto it = view.row_begin(y);
-        for (std::size_t x = 0; x < width; x++) {
-            auto &pixel = it[x];
-            const auto i = y * width + x;
-            boost::gil::at_c<0>(pixel) = encode(r[i]);
-            boost::gil::at_c<1>(pixel) = encode(g[i]);
-            boost::gil::at_c<2>(pixel) = encode(b[i]);
+    const auto rows = [&](const std::size_t begin, const std::size_t end) {
+        for (std::size_t y = begin; y < end; y++) {
+            const auto it = view.row_begin(y0 - p->top + y) + x0;
+            for (std::size_t x = 0; x < max_x; x++) {
+                auto &pixel = it[x];
+                const auto i = y * stride + x;
+                boost::gil::at_c<0>(pixel) = encode(r[i]);
+                boost::gil::at_c<1>(pixel) = encode(g[i]);
+                boost::gil::at_c<2>(pixel) = encode(b[i]);
+            }
         }
-    }
+    };
+    parallel_rows(max_y, threads, rows);
 }
 
-void image::save_extended(const unsigned extend, const std::complex<double> *r,
-    const std::complex<double> *g, const std::complex<double> *b) {
-    auto &image = p->image;
-    const std::size_t width = image.width();
-    const std::size_t height = image.height();
-    const color_encoder encode{gamma};
-    const auto max_x = width + extend * 2;
+void image::write_rows(const std::size_t end) {
+    if (!p->sink) { return; }
+    const auto view = boost::gil::const_view(p->image);
+    p->sink->write(boost::gil::interleaved_view_get_raw_data(view),
+        end - p->top, view.pixels().row_size());
+    p->top = end;
+}
 
-    const auto view = boost::gil::view(image);
-    for (std::size_t y = 0; y < height; y++) {
-        const auto it = view.row_begin(y);
-        for (std::size_t x = 0; x < width; x++) {
-            auto &pixel = it[x];
-            const auto ix = x + extend, iy = y + extend;
-            const auto i = iy * max_x + ix;
-            boost::gil::at_c<0>(pixel) = encode(r[i]);
-            boost::gil::at_c<1>(pixel) = encode(g[i]);
-            boost::gil::at_c<2>(pixel) = encode(b[i]);
+void image::write(
+    const std::string &filename, const png_writer &writer) const {
+    if (p->raw) {
+        p->raw->commit();
+        return;
+    }
+    if (p->sink) {
+        if (!p->sink->done()) {
+            throw std::runtime_error("incomplete png file: " + filename);
         }
+        return;
     }
+    const auto view = boost::gil::const_view(p->pixels());
+    writer.write(filename, boost::gil::interleaved_view_get_raw_data(view),
+        view.width(), view.height(), view.pixels().row_size());
 }
 
-void image::write(const std::string &filename) const {
-    boost::gil::write_view(
-        filename, boost::gil::const_view(p->image), boost::gil::png_tag{});
-}
+#define INSTANTIATE(T)                                                         \
+    template void image::load(T *, T *, T *, std::size_t) const;               \
+    template void image::load_extended(                                        \
+        unsigned, std::size_t, std::size_t, T *, T *, T *, std::size_t) const; \
+    template void image::load_region(long, long, std::size_t, std::size_t,     \
+        T *, T *, T *, std::size_t) const;                                     \
+    template void image::save(                                                 \
+        const T *, const T *, const T *, std::size_t, unsigned);               \
+    template void image::save_extended(                                        \
+        unsigned, const T *, const T *, const T *, std::size_t, unsigned);     \
+    template void image::save_region(std::size_t, std::size_t, std::size_t,    \
+        std::size_t, const T *, const T *, const T *, std::size_t, unsigned);
+
+INSTANTIATE(float)
+INSTANTIATE(double)
+
+#undef INSTANTIATE
@@ -1,23 +1,42 @@
 #ifndef IMAGECONV_IMAGE_HPP
 #define IMAGECONV_IMAGE_HPP
 
-#include <complex>
+#include "png_writer.hpp"
+
 #include <memory>
 #include <string>
 #include <tuple>
 
 struct image_private;
 
+// Files named *.raw hold the planes as linear floats or doubles behind
+// a small header. They are mapped rather than decoded, keep the full
+// precision, and skip the gamma tables entirely.
 class image final {
     std::unique_ptr<struct image_private> p;
     static constexpr double default_gamma = 2.2;
     const double gamma;
 
 public:
-    explicit image(const std::string &filename);
+    // Without decode, the pixels of an 8-bit RGB file are streamed from the
+    // file into the planes by the first load or load_extended, which can
+    // then be called only once, or by stream_rows for load_region.
+    explicit image(const std::string &filename, bool decode = false);
 
     image(std::size_t width, std::size_t height);
 
+    // An image to be written to filename. A raw file is created and mapped
+    // right away with planes of the given precision, and the saves store
+    // into it; other images are encoded in memory until written.
+    image(const std::string &filename, std::size_t width, std::size_t height,
+        precision_type precision);
+
+    // An image written to filename band by band, holding only rows rows:
+    // write_rows writes those saved since the last call. A raw file is
+    // mapped whole as above.
+    image(const std::string &filename, std::size_t width, std::size_t height,
+        precision_type precision, const png_writer &writer, std::size_t rows);
+
     ~image();
 
     [[nodiscard]] std::tuple<std::size_t, std::size_t> get_size() const;
@@ -25,19 +44,49 @@ public:
     [[nodiscard]] std::tuple<std::size_t, std::size_t> get_extended_size(
         unsigned extend) const;
 
-    void load(std::complex<double> *r, std::complex<double> *g,
-        std::complex<double> *b) const;
+    // The planes below are either float or double.
+
+    template<typename T>
+    void load(T *r, T *g, T *b, std::size_t stride) const;
+
+    // fill a w*h plane with the image at (extend, extend), mirroring it
+    // into the borders
+    template<typename T>
+    void load_extended(unsigned extend, std::size_t w, std::size_t h, T *r,
+        T *g, T *b, std::size_t stride) const;
+
+    // Of a streamed image, read on to the rows that regions of h rows at y0
+    // need and drop the rows before them. The regions must move down.
+    void stream_rows(long y0, std::size_t h);
+
+    // fill a w*h plane with the image region starting at (x0, y0), mirroring
+    // the image where the region leaves it
+    template<typename T>
+    void load_region(long x0, long y0, std::size_t w, std::size_t h, T *r,
+        T *g, T *b, std::size_t stride) const;
+
+    // the saves encode the rows on the given number of threads
+
+    template<typename T>
+    void save(const T *r, const T *g, const T *b, std::size_t stride,
+        unsigned threads = 1);
 
-    void load_extended(unsigned extend, std::complex<double> *r,
-        std::complex<double> *g, std::complex<double> *b) const;
+    template<typename T>
+    void save_extended(unsigned extend, const T *r, const T *g, const T *b,
+        std::size_t stride, unsigned threads = 1);
 
-    void save(const std::complex<double> *r, const std::complex<double> *g,
-        const std::complex<double> *b);
+    // store a w*h plane into the image at (x0, y0)
+    template<typename T>
+    void save_region(std::size_t x0, std::size_t y0, std::size_t w,
+        std::size_t h, const T *r, const T *g, const T *b, std::size_t stride,
+        unsigned threads = 1);
 
-    void save_extended(unsigned extend, const std::complex<double> *r,
-        const std::complex<double> *g, const std::complex<double> *b);
+    // write the rows of a banded image up to end, all saved by now
+    void write_rows(std::size_t end);
 
-    void write(const std::string &filename) const;
+    // a raw image is moved into place under the name it was created with,
+    // and a banded one only checked to be complete
+    void write(const std::string &filename, const png_writer &writer) const;
 };
 
 #endif // IMAGECONV_IMAGE_HPP
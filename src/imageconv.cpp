@@ -2,209 +2,1004 @@
 #include "fft.hpp"
 #include "image.hpp"
 #include "kernel.hpp"
+#include "kernel_cache.hpp"
+#include "lru_cache.hpp"
 #include "methods.hpp"
+#include "stats.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <complex>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <tuple>
+#include <variant>
+#include <vector>
 
-imageconv::imageconv(const options &op) { option = op; }
+using namespace std;
 
-void imageconv::run() const {
-    using namespace std;
-
-    const auto &op = option;
-    cout << op.input << " => " << op.output << endl;
-    cout << "method: " << op.get_method_str() << endl;
+namespace {
+// The planes the read stage decodes an input into, laid out for the engine
+// that computes it: a transform buffer per channel, all three channels in
+// c[0] for the batched plan, or plain planes for the spatial engines. The
+// tiled engine streams the rows itself as its tiles move down.
+template<typename T>
+struct input_planes {
+    array<shared_ptr<complex<T>>, 3> c;
+    vector<T> planes;
+};
 
+struct job {
+    const options *op; // the options of this file
+    string input, output;
     unsigned extend;
-    size_t width, height; // image size
-    size_t w, h;          // transform size
-    shared_ptr<complex<double>> r, g, b;
-    unique_ptr<image> input, output;
+    size_t width, height;   // image size
+    size_t w, h;            // transform size
+    size_t width1, height1; // resize: output image size
+    size_t w1, h1;          // resize: output transform size
+    unique_ptr<image> src, dst;
+    variant<input_planes<float>, input_planes<double>> in;
+    file_stats stats;
+};
+
+long long elapsed_ms(const chrono::steady_clock::time_point begin) {
+    const auto end = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::milliseconds>(end - begin).count();
+}
+
+// the progress report, kept off stdout when it carries the metrics
+ostream &info(const options &op) {
+    return op.stats.empty() ? cout : cerr;
+}
+
+template<typename F>
+void timed(stage_time &stage, const F &f) {
+    const stage_timer timer(stage);
+    f();
+}
+
+// the RGB channels are transformed concurrently, each with its share of the
+// thread budget
+unsigned channel_threads(const options &op) {
+    return min(3u, op.threads);
+}
+
+unsigned fft_threads(const options &op) {
+    return max(1u, op.threads / channel_threads(op));
+}
+
+// the gaussian tail beyond 4 sigma is below the output resolution
+size_t gaussian_radius(const double weight) {
+    return static_cast<size_t>(ceil(weight * 4.0));
+}
 
+// The direct engine does two multiply-adds per tap and pixel, one along
+// each axis, at several times the flop rate of the transforms, which are
+// bound by memory. The transforms take about 2.5 n log2(n) flops each, one
+// forward and one inverse per channel.
+bool use_direct(const options &op, const job &j) {
+    switch (op.engine) {
+    case engine_type::fft:
+    case engine_type::recursive: return false;
+    case engine_type::direct: return true;
+    case engine_type::automatic: break;
+    }
+    // the analytic kernel and the kernel cache are spectra, so asking for
+    // either keeps the fft
+    if (op.method != method_type::gaussian || op.tile > 0 || op.batched ||
+        op.analytic || !op.kernel_cache.empty()) {
+        return false;
+    }
+    constexpr double speedup = 4.0;
+    const auto taps = static_cast<double>(gaussian_radius(op.weight) * 2 + 1);
+    const auto direct = 4.0 * taps * j.width * j.height / speedup;
+    const auto n = static_cast<double>(j.w) * j.h;
+    return direct < 5.0 * n * log2(n);
+}
+
+// The transform sizes of resize along an axis of n pixels resized to n1 by
+// the reduced ratio p / q, large enough for the image with its borders.
+// Within a quarter over the least good size w, the multiples k q and k p
+// that are both good for FFTW keep the ratio exact. Failing that, as when
+// q is about n, the output size is w p / q rounded, the first good one in
+// that range or else the one of w: the output lands at w1 / w of the input
+// positions instead of p / q, less than half an output pixel off at the
+// far edge of the image.
+pair<size_t, size_t> resize_sizes(const size_t n, const size_t n1,
+    const size_t p, const size_t q, const unsigned extend) {
+    const auto good = [](const size_t v) {
+        return fft<double>::good_size(v) == v;
+    };
+    const auto fits = [n1, extend](const size_t w, const size_t w1) {
+        return extend * w1 / w + n1 <= w1;
+    };
+    const auto rounded = [p, q](const size_t w) {
+        return max<size_t>(1, (w * p + q / 2) / q);
+    };
+    auto w = fft<double>::good_size(n + extend * 2);
+    while (!fits(w, rounded(w))) {
+        w = fft<double>::good_size(w + 1);
+    }
+    const auto limit = w + w / 4;
+    for (auto k = (n + extend * 2 + q - 1) / q; k * q <= limit; k++) {
+        if (fits(k * q, k * p) && good(k * q) && good(k * p)) {
+            return {k * q, k * p};
+        }
+    }
+    for (auto v = w; v <= limit; v = fft<double>::good_size(v + 1)) {
+        if (fits(v, rounded(v)) && good(rounded(v))) {
+            return {v, rounded(v)};
+        }
+    }
+    return {w, rounded(w)};
+}
+
+// the output and transform sizes of resize, by op.size_width and
+// op.size_height or by op.scale_num / op.scale_den
+void plan_resize(const options &op, job &j) {
+    const auto axis = [&op, &j](const size_t n, const size_t size) {
+        size_t p = op.scale_num, q = op.scale_den, n1 = size;
+        if (n1 > 0) {
+            p = n1, q = n;
+        } else {
+            n1 = max<size_t>(1, (n * p + q / 2) / q);
+        }
+        const auto d = gcd(p, q);
+        const auto [w, w1] = resize_sizes(n, n1, p / d, q / d, j.extend);
+        return make_tuple(n1, w, w1);
+    };
+    tie(j.width1, j.w, j.w1) = axis(j.width, op.size_width);
+    tie(j.height1, j.h, j.h1) = axis(j.height, op.size_height);
+}
+
+// The computation in precision T with its own plans and kernels. They are
+// shared by all the files, each converted with the options of its job.
+template<typename T>
+struct engine {
+    const planner_type planner;
+    const string wisdom;
+    lru_cache<tuple<size_t, size_t, bool, unsigned, size_t, size_t>,
+        shared_ptr<fft<T>>>
+        plans{8};
+    lru_cache<string, shared_ptr<complex<T>>> kernels{4};
+    atomic<bool> planned{false};
+    mutex storing;
+    vector<future<void>> stores; // kernels being written to the disk cache
+
+    engine(const planner_type planner, string wisdom)
+        : planner(planner), wisdom(move(wisdom)) {}
+
+    shared_ptr<fft<T>> get_plan(size_t w, size_t h, bool backward,
+        unsigned threads, size_t columns = 0, size_t batch = 1);
+    shared_ptr<complex<T>> get_kernel(
+        const options &op, size_t w, size_t h);
+    shared_ptr<complex<T>> get_resize_kernel(const job &j);
+    void store_kernel(const string &dir, const string &key,
+        shared_ptr<complex<T>> k, size_t n);
+    void load_wisdom();
+    void save_wisdom();
+    void cleanup();
+
+    static void load(job &j);
+    void compute(job &j);
+    void compute_tiled(job &j);
+    void compute_batched(job &j);
+    void compute_spatial(job &j, const string &name, const string &detail,
+        size_t scratch, const function<void(T *plane)> &filter);
+    void compute_direct(job &j);
+    void compute_recursive(job &j);
+};
+
+template<typename T>
+shared_ptr<fft<T>> engine<T>::get_plan(const size_t w, const size_t h,
+    const bool backward, const unsigned threads, const size_t columns,
+    const size_t batch) {
+    const auto key = make_tuple(w, h, backward, threads, columns, batch);
+    auto plan = plans.get(key);
+    if (!plan) {
+        plan = make_shared<fft<T>>(
+            w, h, backward, planner, threads, columns, batch);
+        plans.put(key, plan);
+        planned = true;
+    }
+    return plan;
+}
+
+template<typename T>
+void engine<T>::load_wisdom() {
+    if (!wisdom.empty()) { fft<T>::import_wisdom(wisdom); }
+}
+
+template<typename T>
+void engine<T>::save_wisdom() {
+    if (wisdom.empty() || !planned.exchange(false)) { return; }
+    if (!fft<T>::export_wisdom(wisdom)) {
+        cerr << "warning: failed to save wisdom: " << wisdom << endl;
+    }
+}
+
+template<typename T>
+void engine<T>::cleanup() {
     {
-        const auto begin = chrono::steady_clock::now();
+        const lock_guard<mutex> lock(storing);
+        stores.clear();
+    }
+    plans.clear();
+    kernels.clear();
+    fft<T>::cleanup();
+}
 
-        input = make_unique<image>(op.input);
-        tie(width, height) = input->get_size();
-        extend = min(static_cast<unsigned>(min(width, height)), op.extend);
-        tie(w, h) = input->get_extended_size(extend);
-        cout << "image size: " << width << "x" << height << '\n'
+template<typename T>
+shared_ptr<complex<T>> engine<T>::get_kernel(
+    const options &op, const size_t w, const size_t h) {
+    shared_ptr<complex<T>> k;
+    const auto n = fft<T>::buffer_size(w, h);
+    const auto stride = static_cast<int>(fft<T>::real_stride(w));
+    const auto threads = op.threads;
+    function<void(T *)> generate;
+    // kernels computed in frequency domain, of size bins, skip the transform
+    // and the disk cache
+    function<void(complex<T> *)> transformed;
+    auto bins = n;
+    auto name = op.get_method_str();
+    double param = 0.0;
+    switch (op.method) {
+    case method_type::nop:
+        generate = [w, h, stride, threads](T *k) {
+            kernel::identity(k, w, h, stride, threads);
+        };
+        break;
+    case method_type::gaussian:
+        param = op.weight;
+        if (op.analytic) {
+            name += "-analytic";
+            transformed = [w, h, param](complex<T> *k) {
+                kernel::gaussian_spectrum(k, w, h, param);
+            };
+            break;
+        }
+        generate = [w, h, stride, param, threads](T *k) {
+            kernel::gaussian(k, w, h, stride, param, threads);
+        };
+        break;
+    case method_type::spectrum:
+    case method_type::resize: return k; // see get_resize_kernel
+    case method_type::downscale2x:
+        // only the corners that downsample2x keeps
+        param = 2.0;
+        bins = fft<T>::buffer_size(w / 2, h / 2);
+        transformed = [w, h, param, threads](complex<T> *k) {
+            kernel::mitchell_spectrum(k, w, h, param, w / 2, h / 2, threads);
+        };
+        break;
+    case method_type::upscale2x:
+        param = 2.0;
+        generate = [w, h, stride, param, threads](T *k) {
+            kernel::lanczos(k, w, h, stride, param, 10, threads);
+        };
+        break;
+    }
+
+    const auto key = kernel_cache::key<T>(name, w, h, param);
+    k = kernels.get(key);
+    if (k) { return k; }
+    if (transformed) {
+        k = fft<T>::new_buffer(bins);
+        transformed(k.get());
+        kernels.put(key, k);
+        return k;
+    }
+
+    const kernel_cache cache(op.kernel_cache);
+    if (!op.kernel_cache.empty()) { k = cache.load<T>(key, n); }
+    if (!k) {
+        k = fft<T>::new_buffer(n);
+        generate(fft<T>::real(k));
+        get_plan(w, h, false, fft_threads(op))->compute(k);
+        if (!op.kernel_cache.empty()) {
+            store_kernel(op.kernel_cache, key, k, n);
+        }
+    }
+    kernels.put(key, k);
+    return k;
+}
+
+// The kernel of resize, resampled to the output spectrum: mitchell along
+// each axis scaled to its own downscale, or an impulse along an axis that
+// is not downscaled since the zero padding interpolates by itself. It also
+// moves the output by the fraction of a pixel the borders leave it at.
+template<typename T>
+shared_ptr<complex<T>> engine<T>::get_resize_kernel(const job &j) {
+    const auto &op = *j.op;
+    const auto w = j.w, h = j.h, w1 = j.w1, h1 = j.h1;
+    const auto n1 = fft<T>::buffer_size(w1, h1);
+    const auto stride = static_cast<int>(fft<T>::real_stride(w));
+    const auto scale_x = max(1.0, static_cast<double>(w) / w1);
+    const auto scale_y = max(1.0, static_cast<double>(h) / h1);
+    // the scales follow from the sizes in the key
+    const auto name = op.get_method_str() + "-" + to_string(w1) + "x" +
+                      to_string(h1) + "+" + to_string(j.extend);
+    const auto key = kernel_cache::key<T>(name, w, h, 0.0);
+    auto k = kernels.get(key);
+    if (k) { return k; }
+
+    const kernel_cache cache(op.kernel_cache);
+    if (!op.kernel_cache.empty()) { k = cache.load<T>(key, n1); }
+    if (!k) {
+        auto k0 = fft<T>::new_buffer(fft<T>::buffer_size(w, h));
+        kernel::mitchell_separable(fft<T>::real(k0), w, h, stride, scale_x,
+            scale_y, op.threads);
+        get_plan(w, h, false, fft_threads(op))->compute(k0);
+        k = fft<T>::new_buffer(n1);
+        methods::resample(k.get(), k0.get(), static_cast<int>(w),
+            static_cast<int>(h), static_cast<int>(w1), static_cast<int>(h1));
+        methods::shift(k.get(), static_cast<int>(w1), static_cast<int>(h1),
+            static_cast<double>(j.extend * w1 % w) / w,
+            static_cast<double>(j.extend * h1 % h) / h);
+        if (!op.kernel_cache.empty()) {
+            store_kernel(op.kernel_cache, key, k, n1);
+        }
+    }
+    kernels.put(key, k);
+    return k;
+}
+
+// Writes a new kernel to the disk cache in the background, as the file that
+// generated it only needs it in memory. The kernel is not written to again.
+template<typename T>
+void engine<T>::store_kernel(const string &dir, const string &key,
+    shared_ptr<complex<T>> k, const size_t n) {
+    const lock_guard<mutex> lock(storing);
+    stores.erase(remove_if(stores.begin(), stores.end(),
+                     [](const future<void> &it) {
+                         return it.wait_for(chrono::seconds(0)) ==
+                                future_status::ready;
+                     }),
+        stores.end());
+    stores.push_back(async(launch::async, [dir, key, k = move(k), n] {
+        if (!kernel_cache(dir).store(key, k, n)) {
+            cerr << "warning: failed to cache kernel: " << key << endl;
+        }
+    }));
+}
+
+// Decodes the input into the planes of the engine that will compute it,
+// so that the read stage of one file overlaps the compute of the previous.
+template<typename T>
+void engine<T>::load(job &j) {
+    const auto &op = *j.op;
+    auto &in = j.in.emplace<input_planes<T>>();
+    const auto w = j.w, h = j.h;
+    if (op.engine == engine_type::recursive || use_direct(op, j)) {
+        const auto n = j.width * j.height;
+        in.planes.resize(n * 3);
+        auto *const r = in.planes.data();
+        j.src->load(r, r + n, r + n * 2, j.width);
+    } else if (op.tile > 0) {
+        return;
+    } else {
+        const auto n = fft<T>::buffer_size(w, h);
+        const auto stride = fft<T>::real_stride(w);
+        T *planes[3];
+        if (op.batched) {
+            in.c[0] = fft<T>::new_buffer(n * 3);
+            for (int i = 0; i < 3; i++) {
+                planes[i] = fft<T>::real(in.c[0]) + n * 2 * i;
+            }
+        } else {
+            for (int i = 0; i < 3; i++) {
+                in.c[i] = fft<T>::new_buffer(n);
+                planes[i] = fft<T>::real(in.c[i]);
+            }
+        }
+        if (j.extend > 0 || w != j.width || h != j.height) {
+            j.src->load_extended(
+                j.extend, w, h, planes[0], planes[1], planes[2], stride);
+        } else {
+            j.src->load(planes[0], planes[1], planes[2], stride);
+        }
+        j.stats.fft_bytes = n * 3 * sizeof(complex<T>);
+    }
+    j.src = nullptr;
+}
+
+template<typename T>
+void engine<T>::compute(job &j) {
+    const auto &op = *j.op;
+    if (op.engine == engine_type::recursive) {
+        compute_recursive(j);
+        return;
+    }
+    if (use_direct(op, j)) {
+        compute_direct(j);
+        return;
+    }
+    if (op.tile > 0) {
+        compute_tiled(j);
+        return;
+    }
+    if (op.batched) {
+        compute_batched(j);
+        return;
+    }
+    const auto begin = chrono::steady_clock::now();
+    const auto allocated = fft<T>::allocated();
+    auto &s = j.stats;
+
+    const auto width = j.width, height = j.height;
+    const auto w = j.w, h = j.h;
+    auto extend = j.extend;
+    info(op) << j.input << " => " << j.output << '\n'
+             << "image size: " << width << "x" << height << '\n'
              << "transform size: " << w << "x" << h << " = " << w * h << '\n'
+             << "engine: fft\n"
              << "estimated memory: "
-             << ((w * h * sizeof(complex<double>) * 4 + width * height * 4) >>
+             << ((fft<T>::buffer_size(w, h) * sizeof(complex<T>) * 4 +
+                     width * height * 4) >>
                     20u)
              << " MiB" << endl;
+    if (op.method == method_type::resize) {
+        info(op) << "resized to: " << j.width1 << "x" << j.height1
+                 << ", transform size " << j.w1 << "x" << j.h1 << endl;
+    }
+
+    const auto transform = get_plan(w, h, false, fft_threads(op));
+    auto kernel = async([this, &op, &j, &s, w, h] {
+        const stage_timer timer(s.kernel);
+        if (op.method == method_type::resize) { return get_resize_kernel(j); }
+        return get_kernel(op, w, h);
+    });
 
-        const auto end = chrono::steady_clock::now();
-        cerr << "read ... "
-             << chrono::duration_cast<chrono::milliseconds>(end - begin).count()
-             << " ms" << endl;
+    shared_ptr<fft<T>> transform_inv;
+    function<shared_ptr<complex<T>>(
+        shared_ptr<complex<T>>, shared_ptr<complex<T>>)>
+        compute;
+    switch (op.method) {
+    case method_type::nop:
+    case method_type::gaussian: {
+        transform_inv = get_plan(w, h, true, fft_threads(op));
+        compute = [&transform, &transform_inv, &s, w, h](
+                      shared_ptr<complex<T>> c, shared_ptr<complex<T>> k) {
+            timed(s.forward, [&] { transform->compute(c); });
+            timed(s.multiply, [&] {
+                methods::multiply(c.get(), k.get(), fft<T>::buffer_size(w, h));
+            });
+            k = nullptr;
+            timed(s.inverse, [&] { transform_inv->compute(c); });
+            return c;
+        };
+    } break;
+    case method_type::spectrum: {
+        compute = [&transform, &s](
+                      shared_ptr<complex<T>> c, shared_ptr<complex<T>>) {
+            timed(s.forward, [&] { transform->compute(c); });
+            return c;
+        };
+    } break;
+    case method_type::downscale2x: {
+        transform_inv = get_plan(w / 2, h / 2, true, fft_threads(op));
+        compute = [&transform, &transform_inv, &s, w, h](
+                      shared_ptr<complex<T>> c, shared_ptr<complex<T>> k) {
+            timed(s.forward, [&] { transform->compute(c); });
+            auto dst_c =
+                fft<T>::new_buffer(fft<T>::buffer_size(w / 2, h / 2));
+            timed(s.multiply, [&] {
+                methods::downsample2x(dst_c.get(), c.get(), k.get(), w, h);
+            });
+            k = nullptr;
+            c = nullptr;
+            timed(s.inverse, [&] { transform_inv->compute(dst_c); });
+            return dst_c;
+        };
+    } break;
+    case method_type::upscale2x:
+        // upsample2x leaves all but the first spectrum_width(w) columns zero
+        transform_inv = get_plan(
+            w * 2, h * 2, true, fft_threads(op), fft<T>::spectrum_width(w));
+        compute = [&transform, &transform_inv, &s, w, h](
+                      shared_ptr<complex<T>> c, shared_ptr<complex<T>> k) {
+            timed(s.forward, [&] { transform->compute(c); });
+            // const auto n = fft<T>::buffer_size(w, h);
+            // methods::multiply(c.get(), k.get(), n);
+            k = nullptr;
+            auto dst_c =
+                fft<T>::new_buffer(fft<T>::buffer_size(w * 2, h * 2));
+            timed(s.multiply,
+                [&] { methods::upsample2x(dst_c.get(), c.get(), w, h); });
+            c = nullptr;
+            timed(s.inverse, [&] { transform_inv->compute(dst_c); });
+            return dst_c;
+        };
+        break;
+    case method_type::resize: {
+        const auto w1 = j.w1, h1 = j.h1;
+        // the columns past those taken from the input are zero
+        transform_inv = get_plan(w1, h1, true, fft_threads(op),
+            min(fft<T>::spectrum_width(w), fft<T>::spectrum_width(w1)));
+        compute = [&transform, &transform_inv, &s, w, h, w1, h1](
+                      shared_ptr<complex<T>> c, shared_ptr<complex<T>> k) {
+            timed(s.forward, [&] { transform->compute(c); });
+            auto dst_c = fft<T>::new_buffer(fft<T>::buffer_size(w1, h1));
+            timed(s.multiply, [&] {
+                methods::resample(dst_c.get(), c.get(), k.get(),
+                    static_cast<int>(w), static_cast<int>(h),
+                    static_cast<int>(w1), static_cast<int>(h1));
+            });
+            k = nullptr;
+            c = nullptr;
+            timed(s.inverse, [&] { transform_inv->compute(dst_c); });
+            return dst_c;
+        };
+    } break;
     }
+    s.forward_flops = transform->flops();
+    if (transform_inv) { s.inverse_flops = transform_inv->flops(); }
 
-    {
-        const auto begin = chrono::steady_clock::now();
-
-        unique_ptr<fft> transform = make_unique<fft>(w, h);
-        auto data = async([&input, extend, w, h] {
-            auto r = fft::new_buffer(w * h);
-            auto g = fft::new_buffer(w * h);
-            auto b = fft::new_buffer(w * h);
-            if (extend > 0) {
-                input->load_extended(extend, r.get(), g.get(), b.get());
-            } else {
-                input->load(r.get(), g.get(), b.get());
+    auto [r, g, b] = [&op, &j, &kernel, &compute] {
+        auto k = kernel.get();
+        auto c = move(get<input_planes<T>>(j.in).c);
+        atomic<size_t> next{0};
+        const auto worker = [&c, &next, &k, &compute] {
+            for (size_t i; (i = next++) < c.size();) {
+                c[i] = compute(move(c[i]), k);
             }
-            input = nullptr;
-            return make_tuple(r, g, b);
+        };
+        vector<future<void>> workers;
+        for (unsigned i = 1; i < channel_threads(op); i++) {
+            workers.push_back(async(launch::async, worker));
+        }
+        worker();
+        for (auto &it : workers) {
+            it.get();
+        }
+        return make_tuple(c[0], c[1], c[2]);
+    }();
+    save_wisdom();
+
+    auto stride = fft<T>::real_stride(w); // output row stride
+    size_t origin = 0; // output offset of the image when not extended
+    switch (op.method) {
+    case method_type::nop:
+    case method_type::gaussian:
+        j.dst = make_unique<image>(j.output, width, height, op.precision);
+        break;
+    case method_type::spectrum:
+        timed(s.render, [&] {
+            methods::spectrum(fft<T>::real(r), fft<T>::real(g),
+                fft<T>::real(b), stride, r.get(), g.get(), b.get(), w, h,
+                op.threads);
         });
-        auto kernel = async([&transform, &op, w, h] {
-            std::shared_ptr<std::complex<double>> k;
-            switch (op.method) {
-            case method_type::nop: {
-                k = fft::new_buffer(w * h);
-                kernel::identity(k.get(), w, h);
-                transform->compute(k);
-            } break;
-            case method_type::gaussian: {
-                k = fft::new_buffer(w * h);
-                kernel::gaussian(k.get(), w, h, op.weight);
-                transform->compute(k);
-            } break;
-            case method_type::spectrum: break;
-            case method_type::downscale2x: {
-                k = fft::new_buffer(w * h);
-                kernel::mitchell(k.get(), w, h, 2.0);
-                transform->compute(k);
-            } break;
-            case method_type::upscale2x: {
-                k = fft::new_buffer(w * h);
-                kernel::lanczos(k.get(), w, h, 2.0, 10.0);
-                transform->compute(k);
-            } break;
+        j.dst = make_unique<image>(j.output, width, height, op.precision);
+        break;
+    case method_type::downscale2x:
+        j.dst = make_unique<image>(
+            j.output, width / 2, height / 2, op.precision);
+        stride = fft<T>::real_stride(w / 2);
+        extend /= 2;
+        break;
+    case method_type::upscale2x:
+        j.dst = make_unique<image>(
+            j.output, width * 2, height * 2, op.precision);
+        stride = fft<T>::real_stride(w * 2);
+        extend *= 2;
+        break;
+    case method_type::resize:
+        j.dst = make_unique<image>(
+            j.output, j.width1, j.height1, op.precision);
+        stride = fft<T>::real_stride(j.w1);
+        // the whole pixels of the scaled borders, the kernel moved the rest
+        origin = extend * j.h1 / h * stride + extend * j.w1 / w;
+        extend = 0;
+        break;
+    }
+
+    {
+        const stage_timer timer(s.encode);
+        if (extend > 0) {
+            j.dst->save_extended(extend, fft<T>::real(r), fft<T>::real(g),
+                fft<T>::real(b), stride, op.threads);
+        } else {
+            j.dst->save(fft<T>::real(r) + origin, fft<T>::real(g) + origin,
+                fft<T>::real(b) + origin, stride, op.threads);
+        }
+    }
+    s.fft_bytes += fft<T>::allocated() - allocated;
+
+    cerr << "compute ... " << elapsed_ms(begin) << " ms" << endl;
+}
+
+// Overlap-save: every tile is read with a border of the kernel radius and
+// only its inner block, which the circular convolution leaves intact, is
+// stored. The tiles go a row at a time, reading the source from a band of
+// streamed rows and writing each finished band of the destination, so
+// memory grows with the width of the image but not its height. Sources
+// that gil has to decode are still held whole.
+template<typename T>
+void engine<T>::compute_tiled(job &j) {
+    const auto &op = *j.op;
+    const auto begin = chrono::steady_clock::now();
+    const auto allocated = fft<T>::allocated();
+    auto &s = j.stats;
+
+    const auto width = j.width, height = j.height;
+    const auto radius =
+        op.method == method_type::gaussian ? gaussian_radius(op.weight) : 0;
+    const auto n = fft<T>::good_size(max<size_t>(op.tile, radius * 4));
+    const auto block = n - radius * 2;
+    const auto tiles_x = (width + block - 1) / block;
+    const auto tiles_y = (height + block - 1) / block;
+    const auto tiles = tiles_x * tiles_y;
+    const auto workers =
+        static_cast<unsigned>(min<size_t>(op.threads, tiles_x));
+    const auto count = fft<T>::buffer_size(n, n);
+    s.w = s.h = n;
+    s.engine = "tiled";
+    info(op) << j.input << " => " << j.output << '\n'
+             << "image size: " << width << "x" << height << '\n'
+             << "transform size: " << n << "x" << n << " x " << tiles
+             << " tiles\n"
+             << "engine: " << s.engine << '\n'
+             << "estimated memory: "
+             << ((count * sizeof(complex<T>) * (workers * 3 + 1) +
+                     width * n * 6) >>
+                    20u)
+             << " MiB" << endl;
+
+    // the tiles are transformed concurrently, so each plan is single-threaded
+    const auto transform = get_plan(n, n, false, 1);
+    const auto transform_inv = get_plan(n, n, true, 1);
+    s.forward_flops = transform->flops();
+    s.inverse_flops = transform_inv->flops();
+    const auto k = [this, &op, &s, n] {
+        const stage_timer timer(s.kernel);
+        return get_kernel(op, n, n);
+    }();
+    save_wisdom();
+    j.dst = make_unique<image>(j.output, width, height, op.precision,
+        png_writer(op.png_level, op.png_filter, op.threads), block);
+
+    const auto stride = fft<T>::real_stride(n);
+    const auto offset = radius * stride + radius;
+    const auto border = static_cast<long>(radius);
+    vector<array<shared_ptr<complex<T>>, 3>> buffers(workers);
+    for (auto &c : buffers) {
+        for (auto &it : c) {
+            it = fft<T>::new_buffer(count);
+        }
+    }
+    atomic<size_t> next{0};
+    size_t y0 = 0;
+    const auto worker = [&](array<shared_ptr<complex<T>>, 3> &c) {
+        for (size_t i; (i = next++) < tiles_x;) {
+            const auto x0 = i * block;
+            timed(s.decode, [&] {
+                j.src->load_region(static_cast<long>(x0) - border,
+                    static_cast<long>(y0) - border, n, n, fft<T>::real(c[0]),
+                    fft<T>::real(c[1]), fft<T>::real(c[2]), stride);
+            });
+            for (auto &it : c) {
+                timed(s.forward, [&] { transform->compute(it); });
+                timed(s.multiply,
+                    [&] { methods::multiply(it.get(), k.get(), count); });
+                timed(s.inverse, [&] { transform_inv->compute(it); });
             }
-            return k;
-        });
+            timed(s.encode, [&] {
+                j.dst->save_region(x0, y0, min(block, width - x0),
+                    min(block, height - y0), fft<T>::real(c[0]) + offset,
+                    fft<T>::real(c[1]) + offset, fft<T>::real(c[2]) + offset,
+                    stride);
+            });
+        }
+    };
+    for (size_t row = 0; row < tiles_y; row++) {
+        y0 = row * block;
+        next = 0;
+        timed(s.decode,
+            [&] { j.src->stream_rows(static_cast<long>(y0) - border, n); });
+        vector<future<void>> pool;
+        for (unsigned i = 1; i < workers; i++) {
+            pool.push_back(async(launch::async, worker, ref(buffers[i])));
+        }
+        worker(buffers[0]);
+        for (auto &it : pool) {
+            it.get();
+        }
+        timed(s.write, [&] { j.dst->write_rows(min(y0 + block, height)); });
+    }
+    j.src = nullptr;
+    s.fft_bytes += fft<T>::allocated() - allocated;
 
-        unique_ptr<fft> transform_inv;
-        function<shared_ptr<complex<double>>(
-            shared_ptr<complex<double>>, shared_ptr<complex<double>>)>
-            compute;
-        switch (op.method) {
-        case method_type::nop:
-        case method_type::gaussian: {
-            transform_inv = make_unique<fft>(w, h, true);
-            compute = [&transform, &transform_inv, w, h](
-                          shared_ptr<complex<double>> c,
-                          shared_ptr<complex<double>> k) {
-                transform->compute(c);
-                const auto n = w * h;
-                methods::multiply(c.get(), k.get(), n);
-                k = nullptr;
-                transform_inv->compute(c);
-                return c;
-            };
-        } break;
-        case method_type::spectrum: {
-            transform_inv = make_unique<fft>(w, h, true);
-            compute = [&transform](shared_ptr<complex<double>> c,
-                          shared_ptr<complex<double>>) {
-                transform->compute(c);
-                return c;
-            };
-        } break;
-        case method_type::downscale2x: {
-            transform_inv = make_unique<fft>(w / 2, h / 2, true);
-            compute = [&transform, &transform_inv, w, h](
-                          shared_ptr<complex<double>> c,
-                          shared_ptr<complex<double>> k) {
-                transform->compute(c);
-                const auto n = w * h;
-                methods::multiply(c.get(), k.get(), n);
-                k = nullptr;
-                auto dst_c = fft::new_buffer((w / 2) * (h / 2));
-                methods::downsample2x(dst_c.get(), c.get(), w, h);
-                c = nullptr;
-                transform_inv->compute(dst_c);
-                return dst_c;
-            };
-        } break;
-        case method_type::upscale2x:
-            transform_inv = make_unique<fft>(w * 2, h * 2, true);
-            compute = [&transform, &transform_inv, w, h](
-                          shared_ptr<complex<double>> c,
-                          shared_ptr<complex<double>> k) {
-                transform->compute(c);
-                // const auto n = w * h;
-                // methods::multiply(c.get(), k.get(), n);
-                k = nullptr;
-                auto dst_c = fft::new_buffer((w * 2) * (h * 2));
-                methods::upsample2x(dst_c.get(), c.get(), w, h);
-                c = nullptr;
-                transform_inv->compute(dst_c);
-                return dst_c;
-            };
-            break;
+    cerr << "compute ... " << elapsed_ms(begin) << " ms" << endl;
+}
+
+// The three channels are planes of one buffer, transformed by one batched
+// plan on all threads, and the kernel is read once for all of them.
+template<typename T>
+void engine<T>::compute_batched(job &j) {
+    const auto &op = *j.op;
+    const auto begin = chrono::steady_clock::now();
+    const auto allocated = fft<T>::allocated();
+    auto &s = j.stats;
+
+    const auto width = j.width, height = j.height;
+    const auto w = j.w, h = j.h;
+    const auto extend = j.extend;
+    const auto n = fft<T>::buffer_size(w, h);
+    info(op) << j.input << " => " << j.output << '\n'
+             << "image size: " << width << "x" << height << '\n'
+             << "transform size: " << w << "x" << h << " = " << w * h
+             << " x 3 batched\n"
+             << "estimated memory: "
+             << ((n * sizeof(complex<T>) * 4 + width * height * 4) >> 20u)
+             << " MiB" << endl;
+
+    const auto transform = get_plan(w, h, false, op.threads, 0, 3);
+    const auto transform_inv = get_plan(w, h, true, op.threads, 0, 3);
+    s.forward_flops = transform->flops();
+    s.inverse_flops = transform_inv->flops();
+    auto kernel = async([this, &op, &s, w, h] {
+        const stage_timer timer(s.kernel);
+        return get_kernel(op, w, h);
+    });
+
+    const auto c = move(get<input_planes<T>>(j.in).c[0]);
+    const auto stride = fft<T>::real_stride(w);
+    auto *const r = fft<T>::real(c), *const g = r + n * 2, *const b = g + n * 2;
+    timed(s.forward, [&] { transform->compute(c); });
+    {
+        const auto k = kernel.get();
+        timed(s.multiply, [&] { methods::multiply(c.get(), k.get(), n, 3); });
+    }
+    timed(s.inverse, [&] { transform_inv->compute(c); });
+    save_wisdom();
+
+    j.dst = make_unique<image>(j.output, width, height, op.precision);
+    timed(s.encode, [&] {
+        if (extend > 0) {
+            j.dst->save_extended(extend, r, g, b, stride, op.threads);
+        } else {
+            j.dst->save(r, g, b, stride, op.threads);
         }
+    });
+    s.fft_bytes += fft<T>::allocated() - allocated;
 
-        tie(r, g, b) = [&data, &kernel, &compute] {
-            auto k = kernel.get();
-            auto [in_r, in_g, in_b] = data.get();
-            auto future_r = async(compute, in_r, k);
-            auto future_g = async(compute, in_g, k);
-            auto future_b = async(compute, in_b, k);
-            return make_tuple(future_r.get(), future_g.get(), future_b.get());
-        }();
+    cerr << "compute ... " << elapsed_ms(begin) << " ms" << endl;
+}
+
+// The spatial engines filter each channel in place in the planes the read
+// stage decoded, which have the width of the image as their row stride.
+// scratch is the memory the filter holds besides, for the estimate.
+template<typename T>
+void engine<T>::compute_spatial(job &j, const string &name,
+    const string &detail, const size_t scratch,
+    const function<void(T *plane)> &filter) {
+    const auto &op = *j.op;
+    const auto begin = chrono::steady_clock::now();
+    auto &s = j.stats;
 
+    const auto width = j.width, height = j.height;
+    const auto n = width * height;
+    s.w = s.h = 0;
+    s.engine = name;
+    info(op) << j.input << " => " << j.output << '\n'
+             << "image size: " << width << "x" << height << '\n'
+             << "engine: " << name << detail << '\n'
+             << "estimated memory: "
+             << ((n * sizeof(T) * 3 + n * 3 + scratch) >> 20u) << " MiB"
+             << endl;
+
+    auto planes = move(get<input_planes<T>>(j.in).planes);
+    auto *const r = planes.data(), *const g = r + n, *const b = g + n;
+    timed(s.convolve, [&] {
+        for (auto *const it : {r, g, b}) {
+            filter(it);
+        }
+    });
+
+    j.dst = make_unique<image>(j.output, width, height, op.precision);
+    timed(s.encode, [&] { j.dst->save(r, g, b, width, op.threads); });
+
+    cerr << "compute ... " << elapsed_ms(begin) << " ms" << endl;
+}
+
+// Convolves in the image domain with the taps of the gaussian within its
+// radius, one channel after another through a shared scratch plane.
+template<typename T>
+void engine<T>::compute_direct(job &j) {
+    const auto &op = *j.op;
+    const auto width = static_cast<int>(j.width);
+    const auto height = static_cast<int>(j.height);
+    const auto radius = static_cast<int>(gaussian_radius(op.weight));
+    vector<T> tmp(j.width * j.height), taps(radius + 1);
+    timed(j.stats.kernel,
+        [&] { kernel::gaussian_taps(taps.data(), radius, op.weight); });
+    compute_spatial(j, "direct", ", radius " + to_string(radius),
+        (tmp.size() + taps.size()) * sizeof(T), [&](T *plane) {
+            methods::convolve(plane, tmp.data(), width, height, width,
+                taps.data(), radius, op.threads);
+        });
+}
+
+// Filters each channel in place with the recursive approximation of the
+// gaussian, which needs no kernel and no scratch plane.
+template<typename T>
+void engine<T>::compute_recursive(job &j) {
+    const auto &op = *j.op;
+    const auto width = static_cast<int>(j.width);
+    const auto height = static_cast<int>(j.height);
+    compute_spatial(j, "recursive", "", 0, [&](T *plane) {
+        methods::recursive_gaussian(
+            plane, width, height, width, op.weight, op.threads);
+    });
+}
+} // namespace
+
+struct imageconv_private {
+    const options &op;
+    engine<float> f32;
+    engine<double> f64;
+
+    explicit imageconv_private(const options &op)
+        : op(op),
+          f32(op.planner, op.wisdom.empty() ? "" : op.wisdom + "f"),
+          f64(op.planner, op.wisdom) {}
+
+    void read(job &j) const;
+    void compute(job &j);
+    void write(job &j) const;
+};
+
+void imageconv_private::read(job &j) const {
+    const auto &op = *j.op;
+    const auto begin = chrono::steady_clock::now();
+    const stage_timer timer(j.stats.decode);
+
+    // only the header, the rows are streamed into the planes below or into
+    // the band of the tiled engine
+    j.src = make_unique<image>(j.input);
+    tie(j.width, j.height) = j.src->get_size();
+    j.extend = min(static_cast<unsigned>(min(j.width, j.height)), op.extend);
+    tie(j.w, j.h) = j.src->get_extended_size(j.extend);
+    if (op.method == method_type::resize) {
+        plan_resize(op, j);
+    } else if (j.extend > 0) {
+        // the borders are not periodic anyway, so pad them further to
+        // a size FFTW handles well
         switch (op.method) {
-        case method_type::nop:
-        case method_type::gaussian:
-            output = make_unique<image>(width, height);
-            break;
-        case method_type::spectrum:
-            methods::spectrum(r.get(), g.get(), b.get(), r.get(), g.get(),
-                b.get(), width, height);
-            output = make_unique<image>(width, height);
-            break;
         case method_type::downscale2x:
-            output = make_unique<image>(width / 2, height / 2);
-            extend /= 2;
+            j.w = fft<double>::good_size((j.w + 1) / 2) * 2;
+            j.h = fft<double>::good_size((j.h + 1) / 2) * 2;
             break;
-        case method_type::upscale2x:
-            output = make_unique<image>(width * 2, height * 2);
-            extend *= 2;
+        default:
+            j.w = fft<double>::good_size(j.w);
+            j.h = fft<double>::good_size(j.h);
             break;
         }
+    }
+    j.stats.input = j.input;
+    j.stats.output = j.output;
+    j.stats.width = j.width;
+    j.stats.height = j.height;
+    j.stats.w = j.w;
+    j.stats.h = j.h;
+    switch (op.precision) {
+    case precision_type::float32: engine<float>::load(j); break;
+    case precision_type::float64: engine<double>::load(j); break;
+    }
 
-        if (extend > 0) {
-            output->save_extended(extend, r.get(), g.get(), b.get());
-        } else {
-            output->save(r.get(), g.get(), b.get());
-        }
-        r = nullptr;
-        g = nullptr;
-        b = nullptr;
-        transform = nullptr;
-        transform_inv = nullptr;
+    cerr << "read " << j.input << " ... " << elapsed_ms(begin) << " ms"
+         << endl;
+}
 
-        const auto end = chrono::steady_clock::now();
-        cerr << "compute ... "
-             << chrono::duration_cast<chrono::milliseconds>(end - begin).count()
-             << " ms" << endl;
+void imageconv_private::compute(job &j) {
+    switch (j.op->precision) {
+    case precision_type::float32: f32.compute(j); break;
+    case precision_type::float64: f64.compute(j); break;
     }
-    fft::cleanup();
+}
 
+void imageconv_private::write(job &j) const {
+    const auto &op = *j.op;
+    const auto begin = chrono::steady_clock::now();
     {
-        const auto begin = chrono::steady_clock::now();
-        output->write(op.output);
-        const auto end = chrono::steady_clock::now();
-        cerr << "save ... "
-             << chrono::duration_cast<chrono::milliseconds>(end - begin).count()
-             << " ms" << endl;
+        const stage_timer timer(j.stats.write);
+        j.dst->write(
+            j.output, png_writer(op.png_level, op.png_filter, op.threads));
+        j.dst = nullptr;
     }
+    cerr << "save " << j.output << " ... " << elapsed_ms(begin) << " ms"
+         << endl;
+}
+
+imageconv::imageconv(const options &op)
+    : option(op), p(make_unique<imageconv_private>(option)) {
+    p->f32.load_wisdom();
+    p->f64.load_wisdom();
+}
+
+imageconv::~imageconv() = default;
+
+size_t imageconv::run() {
+    const auto &op = option;
+    const auto &files = op.files;
+    info(op) << "method: " << op.get_method_str() << endl;
+    info(op) << "precision: " << op.get_precision_str() << endl;
+    info(op) << "planner: " << op.get_planner_str() << endl;
+    info(op) << "threads: " << op.threads << endl;
+
+    size_t failed = 0;
+    const auto fail = [&failed](const string &file, const exception &ex) {
+        cerr << "error: " << file << ": " << ex.what() << endl;
+        failed++;
+    };
+    const auto read = [this, &op, &files](const size_t i) {
+        auto j = make_unique<job>();
+        j->op = &op;
+        tie(j->input, j->output) = files[i];
+        p->read(*j);
+        return j;
+    };
+
+    future<unique_ptr<job>> reading;
+    future<void> writing;
+    string written;
+    if (!files.empty()) { reading = async(launch::async, read, 0); }
+    for (size_t i = 0; i < files.size(); i++) {
+        unique_ptr<job> j;
+        try {
+            j = reading.get();
+        } catch (const exception &ex) { fail(files[i].first, ex); }
+        if (i + 1 < files.size()) {
+            reading = async(launch::async, read, i + 1);
+        }
+        if (!j) { continue; }
+
+        try {
+            p->compute(*j);
+        } catch (const exception &ex) {
+            fail(j->input, ex);
+            continue;
+        }
+
+        if (writing.valid()) {
+            try {
+                writing.get();
+            } catch (const exception &ex) { fail(written, ex); }
+        }
+        written = j->output;
+        writing = async(launch::async, [this, &op, j = move(j)] {
+            p->write(*j);
+            if (op.stats == "json") {
+                cout << j->stats.to_json() + '\n' << flush;
+            }
+        });
+    }
+    if (writing.valid()) {
+        try {
+            writing.get();
+        } catch (const exception &ex) { fail(written, ex); }
+    }
+
+    p->f32.cleanup();
+    p->f64.cleanup();
+    return failed;
+}
+
+string imageconv::convert(
+    const options &op, const string &input, const string &output) {
+    job j;
+    j.op = &op;
+    j.input = input;
+    j.output = output;
+    p->read(j);
+    p->compute(j);
+    p->write(j);
+    return j.stats.to_json();
 }
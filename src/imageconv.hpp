@@ -3,13 +3,30 @@
 
 #include "options.hpp"
 
+#include <memory>
+#include <string>
+
+struct imageconv_private;
+
 class imageconv {
     options option;
+    std::unique_ptr<struct imageconv_private> p;
 
 public:
     explicit imageconv(const options &);
 
-    void run() const;
+    ~imageconv();
+
+    // Converts all files in the options. Reading the next file and writing
+    // the previous one overlap with the computation of the current one.
+    // Returns the number of files that failed.
+    std::size_t run();
+
+    // Converts one file with its own options, keeping the plans and kernels
+    // for the next ones. It may be called from several threads at once.
+    // Returns the metrics of the file as JSON and throws if it fails.
+    std::string convert(const options &op, const std::string &input,
+        const std::string &output);
 };
 
 #endif // IMAGECONV_IMAGECONV_HPP
@@ -1,6 +1,10 @@
 #include "kernel.hpp"
+#include "planes.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
+#include <vector>
 
 namespace {
 inline double sqr(double x) { return x * x; }
@@ -16,42 +20,136 @@ inline int map_axis(const int v, const int max) {
     return v - max;
 }
 
-void normalize(
-    std::complex<double> *kernel, const double sum, const int w, const int h) {
-    const auto scale = w * h * sum;
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            auto &v = kernel[y * w + x];
-            v = v.real() / scale;
-        }
+using planes::parallel_rows;
+
+// the coordinates along an axis of length n whose distance to 0 through
+// map_axis is at most r, with that distance
+std::vector<std::pair<int, int>> window(const int n, const int r) {
+    std::vector<std::pair<int, int>> result;
+    for (int v = 0; v < n; v++) {
+        const auto d = abs(map_axis(v, n));
+        if (d <= r) { result.emplace_back(v, d); }
+        // skip the middle of the axis, which is out of reach
+        if (v == r && n - r > v + 1) { v = n - r - 1; }
     }
+    return result;
 }
-} // namespace
 
-void kernel::identity(std::complex<double> *kernel, const int w, const int h) {
-    const auto n = w * h;
-    kernel[0] = 1.0 / n;
-    for (int i = 1; i < n; i++) {
-        kernel[i] = 0;
+// the plane of the outer product of the tables along x and y, which are
+// zero outside the windows
+template<typename T>
+void outer(T *kernel, const int w, const int h, const int stride,
+    const std::vector<std::pair<int, int>> &wx, const std::vector<double> &tx,
+    const std::vector<std::pair<int, int>> &wy, const std::vector<double> &ty,
+    const unsigned threads) {
+    std::vector<double> row(w);
+    for (std::size_t i = 0; i < wx.size(); i++) {
+        row[wx[i].first] = tx[i];
+    }
+    std::vector<double> column(h);
+    for (std::size_t i = 0; i < wy.size(); i++) {
+        column[wy[i].first] = ty[i];
     }
+    parallel_rows(h, threads, [&](const int begin, const int end) {
+        for (int y = begin; y < end; y++) {
+            auto *const out = kernel + static_cast<long>(y) * stride;
+            const auto sy = column[y];
+            if (sy == 0.0) {
+                std::fill_n(out, w, T(0));
+                continue;
+            }
+            for (int x = 0; x < w; x++) {
+                out[x] = static_cast<T>(row[x] * sy);
+            }
+        }
+    });
+}
+} // namespace
+
+template<typename T>
+void kernel::identity(T *kernel, const int w, const int h, const int stride,
+    const unsigned threads) {
+    parallel_rows(h, threads, [=](const int begin, const int end) {
+        for (int y = begin; y < end; y++) {
+            std::fill_n(kernel + static_cast<long>(y) * stride, w, T(0));
+        }
+    });
+    kernel[0] = 1.0 / (w * h);
 }
 
-void kernel::gaussian(std::complex<double> *kernel, const int w, const int h,
-    const double weight) {
+// The gaussian is the product of one along each axis, so the plane is the
+// outer product of two tables, each normalized on its own.
+template<typename T>
+void kernel::gaussian(T *kernel, const int w, const int h,
+    const int stride, const double weight, const unsigned threads) {
     using namespace std;
-    const auto scale = 1.0 / (2.0 * M_PI * sqr(weight)) / (w * h);
     const auto constant = -2.0 * sqr(weight);
+    const auto table = [constant](const int n, const double scale) {
+        auto axis = window(n, n);
+        vector<double> t(axis.size());
+        auto sum = 0.0;
+        for (size_t i = 0; i < t.size(); i++) {
+            t[i] = exp(sqr(axis[i].second) / constant);
+            sum += t[i];
+        }
+        for (auto &it : t) {
+            it /= sum * scale;
+        }
+        return make_pair(move(axis), move(t));
+    };
+    const auto [wx, tx] = table(w, w * static_cast<double>(h));
+    const auto [wy, ty] = table(h, 1.0);
+    outer(kernel, w, h, stride, wx, tx, wy, ty, threads);
+}
+
+template<typename T>
+void kernel::gaussian_taps(T *k, const int radius, const double weight) {
+    using namespace std;
+    vector<double> taps(radius + 1);
     auto sum = 0.0;
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            const auto value =
-                exp((sqr(map_axis(x, w)) + sqr(map_axis(y, h))) / constant) *
-                scale;
-            sum += value;
-            kernel[y * w + x] = value;
+    for (int i = 0; i <= radius; i++) {
+        taps[i] = exp(sqr(i) / (-2.0 * sqr(weight)));
+        sum += i == 0 ? taps[i] : taps[i] * 2.0;
+    }
+    for (int i = 0; i <= radius; i++) {
+        k[i] = static_cast<T>(taps[i] / sum);
+    }
+}
+
+namespace {
+// DFT of exp(-x^2 / (2 weight^2)) periodized with period n, at frequency u
+double gaussian_dft(const int u, const int n, const double weight) {
+    const auto a = -2.0 * M_PI * M_PI * sqr(weight);
+    auto sum = std::exp(a * sqr(static_cast<double>(u) / n));
+    for (int m = 1;; m++) {
+        const auto t = std::exp(a * sqr(static_cast<double>(u) / n + m)) +
+                       std::exp(a * sqr(static_cast<double>(u) / n - m));
+        sum += t;
+        if (t <= sum * 1e-17) { break; }
+    }
+    return sum;
+}
+} // namespace
+
+template<typename T>
+void kernel::gaussian_spectrum(std::complex<T> *spectrum, const int w,
+    const int h, const double weight) {
+    using namespace std;
+    const auto cw = w / 2 + 1;
+    vector<double> tx(cw), ty(h);
+    for (int u = 0; u < cw; u++) {
+        tx[u] = gaussian_dft(u, w, weight);
+    }
+    for (int v = 0; v < h; v++) {
+        ty[v] = gaussian_dft(map_axis(v, h), h, weight);
+    }
+    const auto scale = 1.0 / (tx[0] * ty[0]) / (w * h);
+    for (int v = 0; v < h; v++) {
+        const auto sy = ty[v] * scale;
+        for (int u = 0; u < cw; u++) {
+            spectrum[v * cw + u] = tx[u] * sy;
         }
     }
-    normalize(kernel, sum, w, h);
 }
 
 namespace {
@@ -78,49 +176,171 @@ inline double mitchell_(double x) {
     // clang-format on
     return 0.0;
 }
+
+// The radial filter vanishes from the radius 2 * scale on, so it is
+// evaluated on one quadrant of that radius, which the windows of the plane
+// mirror into its corners. norm makes the plane sum to 1 / (w * h).
+struct mitchell_quadrant {
+    int r;
+    std::vector<std::pair<int, int>> wx, wy;
+    std::vector<double> quadrant;
+    double norm;
+
+    mitchell_quadrant(const int w, const int h, const double scale)
+        : r(static_cast<int>(std::ceil(scale * 2.0))), wx(window(w, r)),
+          wy(window(h, r)), quadrant((r + 1) * (r + 1)) {
+        std::vector<int> count(r + 1);
+        for (const auto &it : wx) {
+            count[it.second]++;
+        }
+        auto sum = 0.0;
+        for (const auto &y : wy) {
+            for (int x = 0; x <= r; x++) {
+                const auto v = mitchell_(std::hypot(x, y.second) / scale);
+                quadrant[y.second * (r + 1) + x] = v;
+                sum += v * count[x];
+            }
+        }
+        norm = 1.0 / (w * static_cast<double>(h) * sum);
+    }
+
+    // the normalized tap at the distances dx and dy from the origin
+    double operator()(const int dx, const int dy) const {
+        return quadrant[dy * (r + 1) + dx] * norm;
+    }
+};
 } // namespace
 
-void kernel::mitchell(std::complex<double> *kernel, const int w, const int h,
-    const double scale) {
+template<typename T>
+void kernel::mitchell(T *kernel, const int w, const int h,
+    const int stride, const double scale, const unsigned threads) {
     using namespace std;
-    auto sum = 0.0;
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            auto &value = kernel[y * w + x];
-            const auto d = hypot(map_axis(x, w), map_axis(y, h));
-            const auto v = mitchell_(d / scale);
-            value = v;
-            sum += v;
-        }
+    const mitchell_quadrant m(w, h, scale);
+    vector<int> reach(h, -1); // the quadrant row of each plane row
+    for (const auto &it : m.wy) {
+        reach[it.first] = it.second;
     }
-    normalize(kernel, sum, w, h);
+    parallel_rows(h, threads, [&](const int begin, const int end) {
+        for (int y = begin; y < end; y++) {
+            auto *const out = kernel + static_cast<long>(y) * stride;
+            std::fill_n(out, w, T(0));
+            if (reach[y] < 0) { continue; }
+            for (const auto &x : m.wx) {
+                out[x.first] = static_cast<T>(m(x.second, reach[y]));
+            }
+        }
+    });
 }
 
-void kernel::lanczos(std::complex<double> *kernel, const int w, const int h,
-    const double scale, const int a) {
+// The plane has a few taps around the origin only, so each coefficient is
+// summed from them directly: first along x for each row of taps, then
+// along y for each output row.
+template<typename T>
+void kernel::mitchell_spectrum(std::complex<T> *spectrum, const int w,
+    const int h, const double scale, const int w1, const int h1,
+    const unsigned threads) {
     using namespace std;
-    auto sum = 0.0;
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            auto &value = kernel[y * w + x];
-            if (x == 0 && y == 0) {
-                value = 1.0;
-                sum += 1.0;
-                continue;
-            }
-            if (x > a || y > a) {
-                value = 0.0;
-                continue;
+    const mitchell_quadrant m(w, h, scale);
+    const auto cw1 = w1 / 2 + 1;
+    // exp(-2 pi i u x / n), with u * x reduced mod n to keep the phase exact
+    const auto phase = [](const int u, const int x, const int n) {
+        const auto t = static_cast<long>(u) * x % n;
+        return polar(1.0, -2.0 * M_PI * static_cast<double>(t) / n);
+    };
+    vector<complex<double>> rows(m.wy.size() * cw1);
+    for (size_t j = 0; j < m.wy.size(); j++) {
+        for (int u = 0; u < cw1; u++) {
+            complex<double> sum;
+            for (const auto &x : m.wx) {
+                sum += m(x.second, m.wy[j].second) * phase(u, x.first, w);
             }
-            const auto sx = map_axis(x, w) * scale;
-            const auto sxa = sx / a;
-            const auto sy = map_axis(y, h) * scale;
-            const auto sya = sy / a;
-            const auto Lxy = (sin(sx) / sx * (sin(sxa) / sxa)) *
-                             (sin(sy) / sy * (sin(sya) / sya));
-            value = Lxy;
-            sum += Lxy;
+            rows[j * cw1 + u] = sum;
         }
     }
-    normalize(kernel, sum, w, h);
+    parallel_rows(h1, threads, [&](const int begin, const int end) {
+        vector<complex<double>> column(m.wy.size());
+        for (int y1 = begin; y1 < end; y1++) {
+            const auto v = map_axis(y1, h1);
+            for (size_t j = 0; j < m.wy.size(); j++) {
+                column[j] = phase(v, m.wy[j].first, h);
+            }
+            auto *const out = spectrum + static_cast<long>(y1) * cw1;
+            for (int u = 0; u < cw1; u++) {
+                complex<double> sum;
+                for (size_t j = 0; j < m.wy.size(); j++) {
+                    sum += column[j] * rows[j * cw1 + u];
+                }
+                out[u] = complex<T>(sum);
+            }
+        }
+    });
 }
+
+template<typename T>
+void kernel::mitchell_separable(T *kernel, const int w, const int h,
+    const int stride, const double scale_x, const double scale_y,
+    const unsigned threads) {
+    using namespace std;
+    const auto table = [](const int n, const double scale,
+                           const double norm) {
+        const auto r = scale > 1.0 ? static_cast<int>(ceil(scale * 2.0)) : 0;
+        auto axis = window(n, r);
+        vector<double> t(axis.size());
+        auto sum = 0.0;
+        for (size_t i = 0; i < t.size(); i++) {
+            t[i] = r > 0 ? mitchell_(axis[i].second / scale) : 1.0;
+            sum += t[i];
+        }
+        for (auto &it : t) {
+            it /= sum * norm;
+        }
+        return make_pair(move(axis), move(t));
+    };
+    const auto [wx, tx] = table(w, scale_x, w * static_cast<double>(h));
+    const auto [wy, ty] = table(h, scale_y, 1.0);
+    outer(kernel, w, h, stride, wx, tx, wy, ty, threads);
+}
+
+// The filter is separable and vanishes beyond a pixels from the origin.
+template<typename T>
+void kernel::lanczos(T *kernel, const int w, const int h,
+    const int stride, const double scale, const int a,
+    const unsigned threads) {
+    using namespace std;
+    const auto table = [scale, a](const int n, const double norm) {
+        auto axis = window(n, a);
+        vector<double> t(axis.size());
+        auto sum = 0.0;
+        for (size_t i = 0; i < t.size(); i++) {
+            const auto s = axis[i].second * scale;
+            t[i] = s == 0.0 ? 1.0 : sin(s) / s * (sin(s / a) / (s / a));
+            sum += t[i];
+        }
+        for (auto &it : t) {
+            it /= sum * norm;
+        }
+        return make_pair(move(axis), move(t));
+    };
+    const auto [wx, tx] = table(w, w * static_cast<double>(h));
+    const auto [wy, ty] = table(h, 1.0);
+    outer(kernel, w, h, stride, wx, tx, wy, ty, threads);
+}
+
+#define INSTANTIATE(T)                                                         \
+    template void kernel::identity(T *, int, int, int, unsigned);              \
+    template void kernel::gaussian(T *, int, int, int, double, unsigned);      \
+    template void kernel::gaussian_taps(T *, int, double);                     \
+    template void kernel::gaussian_spectrum(                                   \
+        std::complex<T> *, int, int, double);                                  \
+    template void kernel::lanczos(                                             \
+        T *, int, int, int, double, int, unsigned);                            \
+    template void kernel::mitchell(T *, int, int, int, double, unsigned);     \
+    template void kernel::mitchell_spectrum(                                   \
+        std::complex<T> *, int, int, double, int, int, unsigned);              \
+    template void kernel::mitchell_separable(                                  \
+        T *, int, int, int, double, double, unsigned);
+
+INSTANTIATE(float)
+INSTANTIATE(double)
+
+#undef INSTANTIATE
@@ -3,18 +3,52 @@
 
 #include <complex>
 
+// Kernels are written as real planes with the given row stride, ready for an
+// in-place r2c transform. They are computed in double precision and stored
+// as T, which is either float or double. The rows of the spatial kernels
+// are written on the given number of threads.
 class kernel final {
 public:
-    static void identity(std::complex<double> *kernel, int width, int height);
+    template<typename T>
+    static void identity(
+        T *kernel, int width, int height, int stride, unsigned threads = 1);
 
-    static void gaussian(
-        std::complex<double> *kernel, int width, int height, double weight);
+    template<typename T>
+    static void gaussian(T *kernel, int width, int height, int stride,
+        double weight, unsigned threads = 1);
 
-    static void lanczos(
-        std::complex<double> *kernel, int w, int h, double scale, int a);
+    // the taps k[0], ..., k[radius] of the 1D gaussian, normalized so that
+    // the kernel they make with k[-i] = k[i] sums to 1
+    template<typename T>
+    static void gaussian_taps(T *k, int radius, double weight);
 
-    static void mitchell(
-        std::complex<double> *kernel, int w, int h, double scale);
+    // the transformed gaussian kernel, computed in frequency domain as the
+    // spectrum of the periodized gaussian, in the fft half layout
+    template<typename T>
+    static void gaussian_spectrum(
+        std::complex<T> *spectrum, int width, int height, double weight);
+
+    template<typename T>
+    static void lanczos(T *kernel, int w, int h, int stride, double scale,
+        int a, unsigned threads = 1);
+
+    template<typename T>
+    static void mitchell(T *kernel, int w, int h, int stride, double scale,
+        unsigned threads = 1);
+
+    // the transformed mitchell kernel of a w x h plane, in the fft half
+    // layout of a w1 x h1 spectrum cropped from it as methods::downsample2x
+    // does, without the plane or its transform; the rows are written on
+    // the given number of threads
+    template<typename T>
+    static void mitchell_spectrum(std::complex<T> *spectrum, int w, int h,
+        double scale, int w1, int h1, unsigned threads = 1);
+
+    // the product of a mitchell filter along each axis at a scale of its
+    // own, or of an impulse along an axis scaled by 1 or less
+    template<typename T>
+    static void mitchell_separable(T *kernel, int w, int h, int stride,
+        double scale_x, double scale_y, unsigned threads = 1);
 };
 
 #endif // IMAGECONV_KERNEL_HPP
@@ -0,0 +1,122 @@
+#include "kernel_cache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace {
+constexpr char magic[8] = {'I', 'C', 'K', 'E', 'R', 'N', 'E', 'L'};
+constexpr uint32_t version = 2;
+
+// the header is padded so that the data stays aligned for SIMD loads
+struct alignas(64) header {
+    char magic[8];
+    uint32_t version;
+    uint32_t elem_size;
+    uint64_t count;
+};
+static_assert(sizeof(header) == 64, "unexpected header size");
+} // namespace
+
+kernel_cache::kernel_cache(string dir) : dir(move(dir)) {}
+
+template<typename T>
+string kernel_cache::key(const string &method, const size_t width,
+    const size_t height, const double param) {
+    uint64_t bits;
+    memcpy(&bits, &param, sizeof(bits));
+    char buf[64];
+    snprintf(buf, sizeof(buf), "-%zux%zu-%016llx-f%zu", width, height,
+        static_cast<unsigned long long>(bits), sizeof(T) * 8);
+    return method + buf;
+}
+
+template<typename T>
+shared_ptr<complex<T>> kernel_cache::load(
+    const string &key, const size_t n) const {
+    const auto path = dir + "/" + key;
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return nullptr; }
+    struct stat st {};
+    const auto size = sizeof(header) + n * sizeof(complex<T>);
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size) {
+        ::close(fd);
+        return nullptr;
+    }
+    void *const addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) { return nullptr; }
+    const shared_ptr<void> mapping{
+        addr, [size](void *p) { ::munmap(p, size); }};
+
+    const auto hdr = static_cast<const header *>(addr);
+    if (memcmp(hdr->magic, magic, sizeof(magic)) != 0 ||
+        hdr->version != version ||
+        hdr->elem_size != sizeof(complex<T>) || hdr->count != n) {
+        return nullptr;
+    }
+    const auto data = reinterpret_cast<complex<T> *>(
+        static_cast<char *>(addr) + sizeof(header));
+    return shared_ptr<complex<T>>{mapping, data};
+}
+
+template<typename T>
+bool kernel_cache::store(const string &key, const shared_ptr<complex<T>> &buf,
+    const size_t n) const {
+    error_code ec;
+    filesystem::create_directories(dir, ec);
+    if (ec) { return false; }
+
+    // write aside under a name of its own and rename, so concurrent runs
+    // and threads never map a partial entry
+    const auto path = dir + "/" + key;
+    auto tmp = path + ".tmp.XXXXXX";
+    const int fd = ::mkostemp(tmp.data(), O_CLOEXEC);
+    if (fd < 0) { return false; }
+    ::close(fd);
+    header hdr{};
+    memcpy(hdr.magic, magic, sizeof(magic));
+    hdr.version = version;
+    hdr.elem_size = sizeof(complex<T>);
+    hdr.count = n;
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+        out.write(reinterpret_cast<const char *>(buf.get()),
+            static_cast<streamsize>(n * sizeof(complex<T>)));
+        if (!out) {
+            out.close();
+            filesystem::remove(tmp, ec);
+            return false;
+        }
+    }
+    filesystem::rename(tmp, path, ec);
+    if (ec) {
+        filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+#define INSTANTIATE(T)                                                         \
+    template string kernel_cache::key<T>(                                      \
+        const string &, size_t, size_t, double);                               \
+    template shared_ptr<complex<T>> kernel_cache::load(                        \
+        const string &, size_t) const;                                         \
+    template bool kernel_cache::store(                                         \
+        const string &, const shared_ptr<complex<T>> &, size_t) const;
+
+INSTANTIATE(float)
+INSTANTIATE(double)
+
+#undef INSTANTIATE
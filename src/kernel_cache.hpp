@@ -0,0 +1,29 @@
+#ifndef IMAGECONV_KERNEL_CACHE_HPP
+#define IMAGECONV_KERNEL_CACHE_HPP
+
+#include <complex>
+#include <memory>
+#include <string>
+
+// On-disk cache of transformed kernels. Entries are mapped read-only, so the
+// returned buffers must not be written to. T is either float or double.
+class kernel_cache final {
+    const std::string dir;
+
+public:
+    explicit kernel_cache(std::string dir);
+
+    template<typename T>
+    static std::string key(const std::string &method, std::size_t width,
+        std::size_t height, double param);
+
+    template<typename T>
+    [[nodiscard]] std::shared_ptr<std::complex<T>> load(
+        const std::string &key, std::size_t n) const;
+
+    template<typename T>
+    bool store(const std::string &key,
+        const std::shared_ptr<std::complex<T>> &buf, std::size_t n) const;
+};
+
+#endif // IMAGECONV_KERNEL_CACHE_HPP
@@ -0,0 +1,55 @@
+#ifndef IMAGECONV_LRU_CACHE_HPP
+#define IMAGECONV_LRU_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+// A small thread-safe cache which evicts the least recently used entry.
+// Values are expected to be cheap to copy, e.g. shared pointers.
+template<typename K, typename V>
+class lru_cache final {
+    using list_type = std::list<std::pair<K, V>>;
+
+    const std::size_t capacity;
+    list_type items;
+    std::map<K, typename list_type::iterator> index;
+    std::mutex mu;
+
+public:
+    explicit lru_cache(const std::size_t capacity) : capacity(capacity) {}
+
+    V get(const K &key) {
+        std::lock_guard<std::mutex> lock(mu);
+        const auto it = index.find(key);
+        if (it == index.end()) { return V{}; }
+        items.splice(items.begin(), items, it->second);
+        return it->second->second;
+    }
+
+    void put(const K &key, V value) {
+        std::lock_guard<std::mutex> lock(mu);
+        const auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = std::move(value);
+            items.splice(items.begin(), items, it->second);
+            return;
+        }
+        items.emplace_front(key, std::move(value));
+        index.emplace(key, items.begin());
+        while (items.size() > capacity) {
+            index.erase(items.back().first);
+            items.pop_back();
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mu);
+        index.clear();
+        items.clear();
+    }
+};
+
+#endif // IMAGECONV_LRU_CACHE_HPP
@@ -1,9 +1,12 @@
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <boost/program_options.hpp>
 
 #include "imageconv.hpp"
 #include "option_error.hpp"
+#include "server.hpp"
 
 namespace po = boost::program_options;
 
@@ -18,11 +21,27 @@ int main(int ac, char **av) {
 	po::options_description desc("Allowed options");
 	desc.add_options()
 			("help,h", "show this help message")
-			("input,i", po::value<string>(), "set input file")
-			("output,o", po::value<string>(), "set output file")
+			("input,i", po::value<vector<string>>(), "set input file, may be repeated")
+			("output,o", po::value<vector<string>>(), "set output file, one for each input")
+			("batch,b", po::value<string>(), "read input and output pairs from a manifest file")
 			("weight,w", po::value<double>()->default_value(10.0), "set the weight of gaussian kernel")
+			("analytic,a", "generate the gaussian kernel directly in frequency domain")
             ("extend,x", po::value<unsigned>()->default_value(64u), "set max number of extended pixels")
-            ("method,m", po::value<string>()->default_value("gaussian"), "specify method to use (default: gaussian)");
+            ("tile", po::value<unsigned>()->default_value(0u), "convolve in tiles of this transform size to bound memory (nop and gaussian only, 0 to disable)")
+            ("batched", "transform the RGB channels together with one batched plan (nop and gaussian only)")
+            ("method,m", po::value<string>()->default_value("gaussian"), "specify method to use (default: gaussian)")
+            ("size,s", po::value<string>()->default_value("1/1"), "set the output of resize: WxH, or a factor of the input size such as 1/8 or 3/2")
+            ("engine,e", po::value<string>()->default_value("auto"), "set gaussian engine: fft, direct, recursive for a cost independent of the weight, or auto to pick the faster of fft and direct by a cost model (fft with --analytic or --kernel-cache)")
+            ("precision", po::value<string>()->default_value("double"), "set compute precision: float or double")
+            ("threads,t", po::value<unsigned>(), "set number of threads (default: all cores)")
+            ("png-level", po::value<unsigned>()->default_value(3u), "set PNG compression level from 0 to 9")
+            ("png-filter", po::value<string>()->default_value("adaptive"), "set PNG row filter: none, sub, up, average, paeth or adaptive")
+            ("planner,p", po::value<string>()->default_value("estimate"), "set FFTW planner rigor: estimate, measure or patient")
+            ("wisdom", po::value<string>(), "set FFTW wisdom file (default: ~/.cache/imageconv/wisdom, empty to disable)")
+            ("kernel-cache", po::value<string>(), "cache kernel spectra in this directory across runs, unbounded (default: none)")
+            ("stats", po::value<string>(), "print one record of per-stage metrics per file to stdout: json")
+            ("serve", po::value<string>(), "serve requests on this Unix socket, keeping plans and kernels warm")
+            ("jobs,j", po::value<unsigned>()->default_value(2u), "set number of requests served at once");
     // clang-format on
     options op;
 
@@ -36,26 +55,78 @@ int main(int ac, char **av) {
             return EXIT_SUCCESS;
         }
 
-        if (!vm.count("input")) {
-            throw option_error("required option is missing: input");
+        if (!vm.count("batch") && !vm.count("serve")) {
+            if (!vm.count("input")) {
+                throw option_error("required option is missing: input");
+            }
+            if (!vm.count("output")) {
+                throw option_error("required option is missing: output");
+            }
         }
-        if (!vm.count("output")) {
-            throw option_error("required option is missing: output");
+        if (vm.count("input") || vm.count("output")) {
+            const vector<string> none;
+            const auto &inputs =
+                vm.count("input") ? vm["input"].as<vector<string>>() : none;
+            const auto &outputs = vm.count("output")
+                                      ? vm["output"].as<vector<string>>()
+                                      : none;
+            if (inputs.size() != outputs.size()) {
+                throw option_error("number of inputs and outputs differ");
+            }
+            for (size_t i = 0; i < inputs.size(); i++) {
+                op.files.emplace_back(inputs[i], outputs[i]);
+            }
         }
-
-        op.input = vm["input"].as<string>();
-        op.output = vm["output"].as<string>();
+        if (vm.count("batch")) { op.read_manifest(vm["batch"].as<string>()); }
         op.weight = vm["weight"].as<double>();
+        op.analytic = vm.count("analytic") > 0;
         op.extend = vm["extend"].as<unsigned>();
+        op.tile = vm["tile"].as<unsigned>();
+        op.batched = vm.count("batched") > 0;
         const auto method = vm["method"].as<string>();
         if (!op.set_method_str(method)) {
             throw option_error("unknown method: " + method);
         }
+        const auto size = vm["size"].as<string>();
+        if (!op.set_size_str(size)) {
+            throw option_error("invalid size: " + size);
+        }
+        const auto engine = vm["engine"].as<string>();
+        if (!op.set_engine_str(engine)) {
+            throw option_error("unknown engine: " + engine);
+        }
+        const auto precision = vm["precision"].as<string>();
+        if (!op.set_precision_str(precision)) {
+            throw option_error("unknown precision: " + precision);
+        }
+        const auto planner = vm["planner"].as<string>();
+        if (!op.set_planner_str(planner)) {
+            throw option_error("unknown planner: " + planner);
+        }
+        if (vm.count("threads")) { op.threads = vm["threads"].as<unsigned>(); }
+        op.png_level = vm["png-level"].as<unsigned>();
+        const auto png_filter = vm["png-filter"].as<string>();
+        if (!op.set_png_filter_str(png_filter)) {
+            throw option_error("unknown png filter: " + png_filter);
+        }
+        if (vm.count("wisdom")) { op.wisdom = vm["wisdom"].as<string>(); }
+        if (vm.count("kernel-cache")) {
+            op.kernel_cache = vm["kernel-cache"].as<string>();
+        }
+        if (vm.count("stats")) { op.stats = vm["stats"].as<string>(); }
+        if (vm.count("serve")) { op.serve = vm["serve"].as<string>(); }
+        op.jobs = vm["jobs"].as<unsigned>();
 
         op.check();
 
+        if (!op.serve.empty()) {
+            server s(op);
+            cerr << "serving on " << op.serve << endl;
+            s.run();
+            return EXIT_SUCCESS;
+        }
         imageconv o(op);
-        o.run();
+        if (o.run() > 0) { return EXIT_FAILURE; }
     } catch (const option_error &ex) {
         cerr << "argument error: " << ex.what() << endl;
         cerr << desc << endl;
@@ -1,8 +1,15 @@
 #include "methods.hpp"
+#include "planes.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <complex>
+#include <cstdint>
+#include <cstring>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace {
 template<typename T>
@@ -11,21 +18,34 @@ inline T abs(T x) {
 }
 } // namespace
 
-void methods::copy(
-    std::complex<double> *dst, std::complex<double> *src, const int n) {
+template<typename T>
+void methods::copy(std::complex<T> *dst, std::complex<T> *src, const int n) {
     for (int i = 0; i < n; i++) {
         dst[i] = src[i];
     }
 }
 
+template<typename T>
 void methods::multiply(
-    std::complex<double> *a, const std::complex<double> *k, const int n) {
+    std::complex<T> *a, const std::complex<T> *k, const int n) {
     for (int i = 0; i < n; i++) {
         a[i] *= k[i];
     }
 }
 
-void methods::lowpass(std::complex<double> *a, const int w, const int h,
+template<typename T>
+void methods::multiply(std::complex<T> *a, const std::complex<T> *k,
+    const int n, const int batch) {
+    for (int i = 0; i < n; i++) {
+        const auto v = k[i];
+        for (int j = 0; j < batch; j++) {
+            a[static_cast<long>(j) * n + i] *= v;
+        }
+    }
+}
+
+template<typename T>
+void methods::lowpass(std::complex<T> *a, const int w, const int h,
     const int w1, const int h1) {
     for (int y = 0; y < h1; y++) {
         for (int x = w1; x < w - w1; x++) {
@@ -44,7 +64,8 @@ void methods::lowpass(std::complex<double> *a, const int w, const int h,
     }
 }
 
-void methods::fftshift(std::complex<double> *a, std::complex<double> *t,
+template<typename T>
+void methods::fftshift(std::complex<T> *a, std::complex<T> *t,
     const int w, const int h) {
     const auto w2 = w / 2;
     const auto h2 = h / 2;
@@ -60,7 +81,8 @@ void methods::fftshift(std::complex<double> *a, std::complex<double> *t,
     }
 }
 
-void methods::ifftshift(std::complex<double> *a, std::complex<double> *t,
+template<typename T>
+void methods::ifftshift(std::complex<T> *a, std::complex<T> *t,
     const int w, const int h) {
     const auto w2 = w - w / 2;
     const auto h2 = h - h / 2;
@@ -86,103 +108,505 @@ inline std::tuple<double, double, double> palette(const double v) {
 }
 } // namespace
 
-void methods::spectrum(std::complex<double> *dst_r, std::complex<double> *dst_g,
-    std::complex<double> *dst_b, const std::complex<double> *src_r,
-    const std::complex<double> *src_g, const std::complex<double> *src_b,
-    const int width, const int height) {
+namespace {
+using planes::mirror;
+using planes::parallel_bands;
+
+// Radix select on the bit patterns of the non-negative values, which sort
+// like the values. Returns the ks-th smallest values of the full plane, in
+// which lum[y * stride + x] also stands for its mirror when
+// 0 < x <= width - cw.
+template<typename T, std::size_t N>
+std::array<T, N> select(const T *lum, const int stride, const int width,
+    const int height, const std::array<std::size_t, N> ks, const int bands) {
     using namespace std;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            const auto i = y * width + x;
-            const auto v = 0.2126 * norm(src_r[i]) + 0.7152 * norm(src_g[i]) +
-                           0.0722 * norm(src_b[i]);
-            dst_r[i] = v;
-            dst_g[i] = v;
-        }
-    }
-    std::sort(dst_g, dst_g + (width * height),
-        [](std::complex<double> a, std::complex<double> b) {
-            return a.real() < b.real();
+    using U = conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+    constexpr int digit_bits = 16;
+    constexpr size_t digits = size_t(1) << digit_bits;
+    const auto cw = width / 2 + 1;
+    const auto mirrored = width - cw;
+    array<U, N> prefix{};
+    array<uint64_t, N> k{};
+    copy(ks.begin(), ks.end(), k.begin());
+    U mask = 0;
+    for (int shift = static_cast<int>(sizeof(U)) * 8 - digit_bits; shift >= 0;
+         shift -= digit_bits) {
+        vector<vector<uint64_t>> count(bands, vector<uint64_t>(N * digits));
+        parallel_bands(height, bands, [&](const int band, const int begin,
+                                         const int end) {
+            auto &c = count[band];
+            for (int y = begin; y < end; y++) {
+                for (int x = 0; x < cw; x++) {
+                    U u;
+                    memcpy(&u, &lum[y * stride + x], sizeof(u));
+                    const auto digit = (u >> shift) & (digits - 1);
+                    const auto weight = 0 < x && x <= mirrored ? 2u : 1u;
+                    for (size_t t = 0; t < N; t++) {
+                        if ((u & mask) == prefix[t]) {
+                            c[t * digits + digit] += weight;
+                        }
+                    }
+                }
+            }
         });
-    const auto v0 = dst_g[static_cast<int>(0.05 * (width * height - 1))].real();
-    const auto k =
-        1.0 / dst_g[static_cast<int>(0.95 * (width * height - 1))].real();
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            const auto i = y * width + x;
-            const auto v = dst_r[i].real();
-            tie(dst_r[i], dst_g[i], dst_b[i]) = palette(k * (v - v0));
+        for (size_t t = 0; t < N; t++) {
+            for (U digit = 0;; digit++) {
+                uint64_t n = 0;
+                for (const auto &c : count) {
+                    n += c[t * digits + digit];
+                }
+                if (k[t] < n) {
+                    prefix[t] |= digit << shift;
+                    break;
+                }
+                k[t] -= n;
+            }
         }
+        mask |= U(digits - 1) << shift;
+    }
+    array<T, N> result;
+    for (size_t t = 0; t < N; t++) {
+        memcpy(&result[t], &prefix[t], sizeof(T));
     }
+    return result;
+}
+} // namespace
+
+template<typename T>
+void methods::spectrum(T *dst_r, T *dst_g, T *dst_b, const int stride,
+    const std::complex<T> *src_r, const std::complex<T> *src_g,
+    const std::complex<T> *src_b, const int width, const int height,
+    const unsigned threads) {
+    using namespace std;
+    const auto cw = width / 2 + 1;
+    const auto bands = max(1, min(static_cast<int>(threads), height));
+    // the luminance of the half spectrum goes to the first cw columns of
+    // dst_r; when that is src_r seen as reals, row y only overwrites the
+    // coefficients of its own row that it has already read
+    parallel_bands(height, bands, [&](int, const int begin, const int end) {
+        for (int y = begin; y < end; ++y) {
+            for (int x = 0; x < cw; ++x) {
+                const auto i = y * cw + x;
+                dst_r[y * stride + x] = static_cast<T>(
+                    0.2126 * norm(src_r[i]) + 0.7152 * norm(src_g[i]) +
+                    0.0722 * norm(src_b[i]));
+            }
+        }
+    });
+    // the 5th and 95th percentiles; rounding to T keeps their order
+    const auto n = static_cast<size_t>(width) * height;
+    const auto [v0, p95] = select<T, 2>(dst_r, stride, width, height,
+        {static_cast<size_t>(0.05 * (n - 1)),
+            static_cast<size_t>(0.95 * (n - 1))},
+        bands);
+    const auto k = 1.0 / p95;
+    // the mirrored columns, from the first cw columns of the mirrored row,
+    // which no row writes to
+    parallel_bands(height, bands, [&](int, const int begin, const int end) {
+        for (int y = begin; y < end; ++y) {
+            const auto my = (height - y) % height;
+            for (int x = cw; x < width; ++x) {
+                dst_r[y * stride + x] = dst_r[my * stride + (width - x)];
+            }
+        }
+    });
+    parallel_bands(height, bands, [&](int, const int begin, const int end) {
+        for (int y = begin; y < end; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const auto i = y * stride + x;
+                const auto v = dst_r[i];
+                tie(dst_r[i], dst_g[i], dst_b[i]) = palette(k * (v - v0));
+            }
+        }
+    });
 }
 
-void methods::downsample2x(std::complex<double> *dst, std::complex<double> *src,
+template<typename T>
+void methods::downsample2x(std::complex<T> *dst, std::complex<T> *src,
     const int w0, const int h0) {
     using namespace std;
     const auto w1 = w0 / 2;
     const auto h1 = h0 / 2;
-    const auto w2 = w1 / 2;
+    const auto cw0 = w0 / 2 + 1;
+    const auto cw1 = w1 / 2 + 1;
     const auto h2 = h1 / 2;
     for (int y1 = 0; y1 < h2; y1++) {
         const auto y0 = y1;
-        for (int x1 = 0; x1 < w2; x1++) {
-            const auto x0 = x1;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
-        }
-        for (int x1 = w2; x1 < w1; x1++) {
-            const auto x0 = w0 + x1 - w1;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
+        for (int x1 = 0; x1 < cw1; x1++) {
+            dst[y1 * cw1 + x1] = src[y0 * cw0 + x1];
         }
     }
     for (int y1 = h2; y1 < h1; y1++) {
         const auto y0 = h0 + y1 - h1;
-        for (int x1 = 0; x1 < w2; x1++) {
-            const auto x0 = x1;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
+        for (int x1 = 0; x1 < cw1; x1++) {
+            dst[y1 * cw1 + x1] = src[y0 * cw0 + x1];
         }
-        for (int x1 = w2; x1 < w1; x1++) {
-            const auto x0 = w0 + x1 - w1;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
+    }
+}
+
+template<typename T>
+void methods::downsample2x(std::complex<T> *dst, const std::complex<T> *src,
+    const std::complex<T> *k, const int w0, const int h0) {
+    using namespace std;
+    const auto w1 = w0 / 2;
+    const auto h1 = h0 / 2;
+    const auto cw0 = w0 / 2 + 1;
+    const auto cw1 = w1 / 2 + 1;
+    const auto h2 = h1 / 2;
+    for (int y1 = 0; y1 < h1; y1++) {
+        const auto y0 = y1 < h2 ? y1 : h0 + y1 - h1;
+        for (int x1 = 0; x1 < cw1; x1++) {
+            const auto i = y1 * cw1 + x1;
+            dst[i] = src[y0 * cw0 + x1] * k[i];
         }
     }
 }
 
-void methods::upsample2x(std::complex<double> *dst, std::complex<double> *src,
+template<typename T>
+void methods::upsample2x(std::complex<T> *dst, std::complex<T> *src,
     const int w0, const int h0) {
     const int w1 = w0 * 2, h1 = h0 * 2;
-    const int w2 = w0 / 2, h2 = h0 / 2;
+    const int h2 = h0 / 2;
+    const int cw0 = w0 / 2 + 1, cw1 = w1 / 2 + 1;
+    // the Nyquist column of an even w0 stands for +w0 / 2 and -w0 / 2, which
+    // the wider spectrum both has: each takes half of it
+    const int nyquist = w0 % 2 == 0 ? cw0 - 1 : cw0;
     using namespace std;
     for (int y1 = 0; y1 < h2; y1++) {
         const auto y0 = y1;
-        for (int x1 = 0; x1 < w2; x1++) {
-            const auto x0 = x1;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
-        }
-        for (int x1 = w2; x1 < w0 - w2; x1++) {
-            dst[y1 * w1 + x1] = 0;
+        for (int x1 = 0; x1 < cw0; x1++) {
+            dst[y1 * cw1 + x1] = src[y0 * cw0 + x1];
         }
-        for (int x1 = w1 - w2; x1 < w1; x1++) {
-            const auto x0 = x1 - w0;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
+        if (nyquist < cw0) { dst[y1 * cw1 + nyquist] *= T(0.5); }
+        for (int x1 = cw0; x1 < cw1; x1++) {
+            dst[y1 * cw1 + x1] = 0;
         }
     }
     for (int y1 = h2; y1 < h1 - h2; y1++) {
-        for (int x1 = 0; x1 < w1; x1++) {
-            dst[y1 * w1 + x1] = 0;
+        for (int x1 = 0; x1 < cw1; x1++) {
+            dst[y1 * cw1 + x1] = 0;
         }
     }
     for (int y1 = h1 - h2; y1 < h1; y1++) {
         const auto y0 = y1 - h0;
-        for (int x1 = 0; x1 < w2; x1++) {
-            const auto x0 = x1;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
+        for (int x1 = 0; x1 < cw0; x1++) {
+            dst[y1 * cw1 + x1] = src[y0 * cw0 + x1];
+        }
+        if (nyquist < cw0) { dst[y1 * cw1 + nyquist] *= T(0.5); }
+        for (int x1 = cw0; x1 < cw1; x1++) {
+            dst[y1 * cw1 + x1] = 0;
         }
-        for (int x1 = w2; x1 < w0 - w2; x1++) {
-            dst[y1 * w1 + x1] = 0;
+    }
+}
+
+namespace {
+// the row of a spectrum of height h0 that row y1 of one of height h1 takes
+// its frequency from, or -1 if only the latter has it
+int source_row(const int y1, const int h0, const int h1) {
+    const auto m = std::min(h0, h1);
+    if (y1 < (m + 1) / 2) { return y1; }
+    if (y1 >= h1 - m / 2) { return y1 - h1 + h0; }
+    return -1;
+}
+
+template<typename T, typename F>
+void resample_rows(std::complex<T> *dst, const std::complex<T> *src,
+    const int w0, const int h0, const int w1, const int h1, const F &f) {
+    const auto cw0 = w0 / 2 + 1, cw1 = w1 / 2 + 1;
+    const auto cw = std::min(cw0, cw1);
+    // zero padding splits the Nyquist column of an even w0 in halves, as
+    // upsample2x does
+    const auto halve = w1 > w0 && w0 % 2 == 0;
+    for (int y1 = 0; y1 < h1; y1++) {
+        auto *const row = dst + static_cast<long>(y1) * cw1;
+        const auto y0 = source_row(y1, h0, h1);
+        if (y0 < 0) {
+            std::fill_n(row, cw1, std::complex<T>());
+            continue;
         }
-        for (int x1 = w1 - w2; x1 < w1; x1++) {
-            const auto x0 = x1 - w0;
-            dst[y1 * w1 + x1] = src[y0 * w0 + x0];
+        const auto *const in = src + static_cast<long>(y0) * cw0;
+        for (int x = 0; x < cw; x++) {
+            row[x] = f(in[x], static_cast<long>(y1) * cw1 + x);
         }
+        if (halve) { row[cw - 1] *= T(0.5); }
+        std::fill_n(row + cw, cw1 - cw, std::complex<T>());
     }
 }
+} // namespace
+
+template<typename T>
+void methods::resample(std::complex<T> *dst, const std::complex<T> *src,
+    const int w0, const int h0, const int w1, const int h1) {
+    resample_rows(dst, src, w0, h0, w1, h1,
+        [](const std::complex<T> v, long) { return v; });
+}
+
+template<typename T>
+void methods::resample(std::complex<T> *dst, const std::complex<T> *src,
+    const std::complex<T> *k, const int w0, const int h0, const int w1,
+    const int h1) {
+    resample_rows(dst, src, w0, h0, w1, h1,
+        [k](const std::complex<T> v, const long i) { return v * k[i]; });
+}
+
+template<typename T>
+void methods::shift(std::complex<T> *c, const int w, const int h,
+    const double dx, const double dy) {
+    using namespace std;
+    // the phase of each frequency along an axis; the Nyquist frequency of an
+    // even size is its own negative, and a real image keeps the real part
+    const auto phases = [](const int n, const int count, const double d) {
+        vector<complex<double>> p(count);
+        for (int i = 0; i < count; i++) {
+            const auto f = i <= (n - 1) / 2 ? i : i - n;
+            p[i] = n % 2 == 0 && i == n / 2
+                       ? complex<double>(cos(M_PI * d))
+                       : polar(1.0, 2.0 * M_PI * f * d / n);
+        }
+        return p;
+    };
+    const auto cw = w / 2 + 1;
+    const auto px = phases(w, cw, dx), py = phases(h, h, dy);
+    for (int y = 0; y < h; y++) {
+        auto *const row = c + static_cast<long>(y) * cw;
+        for (int x = 0; x < cw; x++) {
+            row[x] *= complex<T>(py[y] * px[x]);
+        }
+    }
+}
+
+template<typename T>
+void methods::convolve(T *plane, T *tmp, const int width, const int height,
+    const int stride, const T *k, const int radius, const unsigned threads) {
+    using namespace std;
+    const auto bands = max(1, min(static_cast<int>(threads), height));
+    // the rows, each read through a copy with its reflected borders
+    parallel_bands(height, bands, [&](int, const int begin, const int end) {
+        vector<T> row(width + radius * 2);
+        for (int y = begin; y < end; y++) {
+            const auto *const src = plane + static_cast<long>(y) * stride;
+            for (int x = 0; x < width + radius * 2; x++) {
+                row[x] = src[mirror(x - radius, width)];
+            }
+            auto *const dst = tmp + static_cast<long>(y) * stride;
+            const auto *const mid = row.data() + radius;
+            for (int x = 0; x < width; x++) {
+                dst[x] = k[0] * mid[x];
+            }
+            for (int i = 1; i <= radius; i++) {
+                const auto ki = k[i];
+                for (int x = 0; x < width; x++) {
+                    dst[x] += ki * (mid[x - i] + mid[x + i]);
+                }
+            }
+        }
+    });
+    // the columns, a whole row at a time
+    parallel_bands(height, bands, [&](int, const int begin, const int end) {
+        for (int y = begin; y < end; y++) {
+            auto *const dst = plane + static_cast<long>(y) * stride;
+            const auto *const src = tmp + static_cast<long>(y) * stride;
+            for (int x = 0; x < width; x++) {
+                dst[x] = k[0] * src[x];
+            }
+            for (int i = 1; i <= radius; i++) {
+                const auto ki = k[i];
+                const auto *const a =
+                    tmp + static_cast<long>(mirror(y - i, height)) * stride;
+                const auto *const b =
+                    tmp + static_cast<long>(mirror(y + i, height)) * stride;
+                for (int x = 0; x < width; x++) {
+                    dst[x] += ki * (a[x] + b[x]);
+                }
+            }
+        }
+    });
+}
+
+namespace {
+// The third order recursion of van Vliet, Young and Verbeek for a gaussian
+// of the given weight, w[i] = b x[i] + a1 w[i-1] + a2 w[i-2] + a3 w[i-3],
+// run forward and then backward. Its poles are those fitted to a gaussian
+// of weight 2, scaled so that the variance of the filter is the square of
+// the weight. At large weights b is far below the rounding error of a1, a2
+// and a3 in float, so the coefficients and the state are double.
+struct recursion {
+    double b, a1, a2, a3;
+    // the states the backward pass starts from, in terms of where the
+    // forward one ended, after Triggs and Sdika
+    double m[3][3];
+
+    explicit recursion(const double weight) {
+        using namespace std;
+        using C = complex<double>;
+        const array<C, 3> poles = {
+            C(1.40098, 1.00236), C(1.40098, -1.00236), C(1.85132, 0)};
+        const auto scaled = [&poles](const double q, const int i) {
+            return pow(poles[i], 1.0 / q);
+        };
+        const auto variance = [&scaled](const double q) {
+            C sum = 0;
+            for (int i = 0; i < 3; i++) {
+                const auto d = scaled(q, i);
+                sum += d * 2.0 / ((d - 1.0) * (d - 1.0));
+            }
+            return sum.real();
+        };
+        // the variance grows with q
+        auto lo = 0.1, hi = max(weight, 1.0) * 2;
+        for (int i = 0; i < 64; i++) {
+            const auto q = (lo + hi) / 2;
+            (variance(q) < weight * weight ? lo : hi) = q;
+        }
+        // the coefficients of (1 - 1/d0 z^-1)(1 - 1/d1 z^-1)(1 - 1/d2 z^-1)
+        array<C, 4> c = {1.0, 0.0, 0.0, 0.0};
+        for (int i = 0; i < 3; i++) {
+            const auto d = scaled(lo, i);
+            for (int k = i + 1; k > 0; k--) {
+                c[k] -= c[k - 1] / d;
+            }
+        }
+        a1 = -c[1].real();
+        a2 = -c[2].real();
+        a3 = -c[3].real();
+        b = 1.0 + c[1].real() + c[2].real() + c[3].real();
+        // their matrix times b, which cancels the factor 1 - a1 - a2 - a3
+        const auto k =
+            1.0 / ((1.0 + a1 - a2 + a3) * (1.0 + a2 + (a1 - a3) * a3));
+        m[0][0] = k * (-a3 * a1 + 1.0 - a3 * a3 - a2);
+        m[0][1] = k * (a3 + a1) * (a2 + a3 * a1);
+        m[0][2] = k * a3 * (a1 + a3 * a2);
+        m[1][0] = k * (a1 + a3 * a2);
+        m[1][1] = -k * (a2 - 1.0) * (a2 + a3 * a1);
+        m[1][2] = -k * a3 * (a3 * a1 + a3 * a3 + a2 - 1.0);
+        m[2][0] = k * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+        m[2][1] = k * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 -
+                          a3 * a2 + a3);
+        m[2][2] = k * a3 * (a1 + a3 * a2);
+    }
+
+    // Runs forward and then backward in place along n samples of the lanes
+    // interleaved lines, which extend past their ends by their end samples.
+    // The line has room for two more samples of each lane.
+    void operator()(double *line, const int n, const int lanes) const {
+        const auto at = [line, lanes](const int i) {
+            return line + static_cast<long>(std::max(i, 0)) * lanes;
+        };
+        // the forward pass starts from the steady state of the first
+        // sample, which it leaves as it is
+        std::copy_n(at(n - 1), lanes, at(n + 1));
+        for (int i = 0; i < n; i++) {
+            auto *const w = at(i);
+            const auto *const w1 = at(i - 1), *const w2 = at(i - 2),
+                             *const w3 = at(i - 3);
+            for (int l = 0; l < lanes; l++) {
+                w[l] = b * w[l] + a1 * w1[l] + a2 * w2[l] + a3 * w3[l];
+            }
+        }
+        // the backward one from y[n - 1], y[n] and y[n + 1] for the last
+        // sample going on
+        auto *const y0 = at(n - 1), *const y1 = at(n), *const y2 = at(n + 1);
+        const auto *const w1 = at(n - 2), *const w2 = at(n - 3);
+        for (int l = 0; l < lanes; l++) {
+            const auto u = y2[l];
+            const double d[] = {y0[l] - u, w1[l] - u, w2[l] - u};
+            double v[3];
+            for (int r = 0; r < 3; r++) {
+                v[r] = m[r][0] * d[0] + m[r][1] * d[1] + m[r][2] * d[2] + u;
+            }
+            y0[l] = v[0];
+            y1[l] = v[1];
+            y2[l] = v[2];
+        }
+        for (int i = n - 2; i >= 0; i--) {
+            auto *const y = at(i);
+            const auto *const z1 = at(i + 1), *const z2 = at(i + 2),
+                             *const z3 = at(i + 3);
+            for (int l = 0; l < lanes; l++) {
+                y[l] = b * y[l] + a1 * z1[l] + a2 * z2[l] + a3 * z3[l];
+            }
+        }
+    }
+};
+} // namespace
+
+template<typename T>
+void methods::recursive_gaussian(T *plane, const int width, const int height,
+    const int stride, const double weight, const unsigned threads) {
+    using namespace std;
+    const recursion filter(weight);
+    const auto bands = max(1, min(static_cast<int>(threads), height));
+    parallel_bands(height, bands, [&](int, const int begin, const int end) {
+        vector<double> line(width + 2);
+        for (int y = begin; y < end; y++) {
+            auto *const row = plane + static_cast<long>(y) * stride;
+            copy_n(row, width, line.begin());
+            filter(line.data(), width, 1);
+            for (int x = 0; x < width; x++) {
+                row[x] = static_cast<T>(line[x]);
+            }
+        }
+    });
+    // the columns in blocks of adjacent ones, which the recursion runs
+    // along together
+    constexpr int block = 16;
+    const auto blocks = (width + block - 1) / block;
+    const auto column_bands = max(1, min(static_cast<int>(threads), blocks));
+    parallel_bands(blocks, column_bands,
+        [&](int, const int begin, const int end) {
+            vector<double> lines(static_cast<size_t>(height + 2) * block);
+            for (int i = begin; i < end; i++) {
+                const auto x0 = i * block;
+                const auto lanes = min(block, width - x0);
+                for (int y = 0; y < height; y++) {
+                    copy_n(plane + static_cast<long>(y) * stride + x0, lanes,
+                        &lines[static_cast<size_t>(y) * lanes]);
+                }
+                filter(lines.data(), height, lanes);
+                for (int y = 0; y < height; y++) {
+                    auto *const dst =
+                        plane + static_cast<long>(y) * stride + x0;
+                    const auto *const src =
+                        &lines[static_cast<size_t>(y) * lanes];
+                    for (int l = 0; l < lanes; l++) {
+                        dst[l] = static_cast<T>(src[l]);
+                    }
+                }
+            }
+        });
+}
+
+#define INSTANTIATE(T)                                                         \
+    template void methods::copy(std::complex<T> *, std::complex<T> *, int);    \
+    template void methods::multiply(                                           \
+        std::complex<T> *, const std::complex<T> *, int);                      \
+    template void methods::multiply(                                           \
+        std::complex<T> *, const std::complex<T> *, int, int);                 \
+    template void methods::lowpass(std::complex<T> *, int, int, int, int);     \
+    template void methods::fftshift(                                           \
+        std::complex<T> *, std::complex<T> *, int, int);                       \
+    template void methods::ifftshift(                                          \
+        std::complex<T> *, std::complex<T> *, int, int);                       \
+    template void methods::spectrum(T *, T *, T *, int,                        \
+        const std::complex<T> *, const std::complex<T> *,                      \
+        const std::complex<T> *, int, int, unsigned);                          \
+    template void methods::downsample2x(                                       \
+        std::complex<T> *, std::complex<T> *, int, int);                       \
+    template void methods::downsample2x(std::complex<T> *,                     \
+        const std::complex<T> *, const std::complex<T> *, int, int);           \
+    template void methods::upsample2x(                                         \
+        std::complex<T> *, std::complex<T> *, int, int);                       \
+    template void methods::convolve(                                           \
+        T *, T *, int, int, int, const T *, int, unsigned);                    \
+    template void methods::recursive_gaussian(                                 \
+        T *, int, int, int, double, unsigned);                                 \
+    template void methods::resample(std::complex<T> *,                         \
+        const std::complex<T> *, int, int, int, int);                          \
+    template void methods::resample(std::complex<T> *,                         \
+        const std::complex<T> *, const std::complex<T> *, int, int, int, int); \
+    template void methods::shift(std::complex<T> *, int, int, double, double);
+
+INSTANTIATE(float)
+INSTANTIATE(double)
+
+#undef INSTANTIATE
@@ -3,30 +3,88 @@
 
 #include <complex>
 
+// T is either float or double.
 namespace methods {
-void copy(std::complex<double> *dst, std::complex<double> *src, int n);
+template<typename T>
+void copy(std::complex<T> *dst, std::complex<T> *src, int n);
 
+template<typename T>
+void multiply(std::complex<T> *a, const std::complex<T> *k, const int n);
+
+// multiply batch planes of n coefficients, one after another, by the same k
+template<typename T>
 void multiply(
-    std::complex<double> *a, const std::complex<double> *k, const int n);
+    std::complex<T> *a, const std::complex<T> *k, int n, int batch);
+
+template<typename T>
+void lowpass(std::complex<T> *a, int w, int h, int w1, int h1);
+
+template<typename T>
+void fftshift(std::complex<T> *dst, std::complex<T> *src, int w, int h);
+
+template<typename T>
+void ifftshift(std::complex<T> *dst, std::complex<T> *src, int w, int h);
+
+// Spectra passed to the functions below are the Hermitian halves produced by
+// fft, i.e. height rows of fft::spectrum_width(width) coefficients.
+
+// The rows are rendered on the given number of threads. The destinations
+// may be the sources seen as reals with stride fft::real_stride(width).
+template<typename T>
+void spectrum(T *dst_r, T *dst_g, T *dst_b, int stride,
+    const std::complex<T> *src_r, const std::complex<T> *src_g,
+    const std::complex<T> *src_b, int width, int height,
+    unsigned threads = 1);
+
+template<typename T>
+void downsample2x(std::complex<T> *dst, std::complex<T> *src, int w0, int h0);
+
+// downsample2x fused with the multiplication by k, which is already cropped
+// to the (w0 / 2)x(h0 / 2) spectrum
+template<typename T>
+void downsample2x(std::complex<T> *dst, const std::complex<T> *src,
+    const std::complex<T> *k, int w0, int h0);
 
-void lowpass(std::complex<double> *a, int w, int h, int w1, int h1);
+template<typename T>
+void upsample2x(std::complex<T> *dst, std::complex<T> *src, int w0, int h0);
 
-void fftshift(
-    std::complex<double> *dst, std::complex<double> *src, int w, int h);
+// Crops or zero pads the w0 x h0 spectrum src to the w1 x h1 spectrum dst,
+// keeping the frequencies both sizes have. Halving and doubling are
+// downsample2x and upsample2x.
+template<typename T>
+void resample(std::complex<T> *dst, const std::complex<T> *src, int w0,
+    int h0, int w1, int h1);
 
-void ifftshift(
-    std::complex<double> *dst, std::complex<double> *src, int w, int h);
+// resample fused with the multiplication by k, which is already resampled
+// to the w1 x h1 spectrum
+template<typename T>
+void resample(std::complex<T> *dst, const std::complex<T> *src,
+    const std::complex<T> *k, int w0, int h0, int w1, int h1);
 
-void spectrum(std::complex<double> *dst_r, std::complex<double> *dst_g,
-    std::complex<double> *dst_b, const std::complex<double> *src_r,
-    const std::complex<double> *src_g, const std::complex<double> *src_b,
-    int width, int height);
+// Multiplies the w x h spectrum c by the phase that moves its image by
+// (-dx, -dy) samples, so that the value at (x + dx, y + dy) lands on (x, y).
+template<typename T>
+void shift(std::complex<T> *c, int w, int h, double dx, double dy);
 
-void downsample2x(
-    std::complex<double> *dst, std::complex<double> *src, int w0, int h0);
+// Convolves a real plane in place with the separable symmetric kernel of
+// the taps k[0], ..., k[radius], along the rows and then the columns,
+// reflecting the plane at its borders as image::load_extended does. tmp is
+// a scratch plane of the same size. The rows are done on the given number
+// of threads.
+template<typename T>
+void convolve(T *plane, T *tmp, int width, int height, int stride,
+    const T *k, int radius, unsigned threads = 1);
 
-void upsample2x(
-    std::complex<double> *dst, std::complex<double> *src, int w0, int h0);
+// Blurs a real plane in place with the recursive approximation of the
+// gaussian of the given weight by van Vliet et al., along the rows and
+// then the columns. Unlike convolve, it extends the plane past its borders
+// by its edge pixels, for which each line starts from exact boundary
+// conditions instead of running through padding, so the cost per pixel
+// does not depend on the weight. The lines are done on the given number of
+// threads.
+template<typename T>
+void recursive_gaussian(T *plane, int width, int height, int stride,
+    double weight, unsigned threads = 1);
 } // namespace methods
 
 #endif // IMAGECONV_METHODS_HPP
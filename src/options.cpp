@@ -3,11 +3,36 @@
 
 #include <boost/format.hpp>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
 #include <vector>
 
-options::options() : weight(10.0), extend(64), method(method_type::gaussian) {}
+namespace {
+std::string default_cache_path(const std::string &name) {
+    if (const auto cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        return std::string(cache) + "/imageconv/" + name;
+    }
+    if (const auto home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.cache/imageconv/" + name;
+    }
+    return "";
+}
+} // namespace
+
+options::options()
+    : weight(10.0), analytic(false), extend(64), tile(0), batched(false),
+      method(method_type::gaussian), size_width(0), size_height(0),
+      scale_num(1), scale_den(1), engine(engine_type::automatic),
+      precision(precision_type::float64),
+      planner(planner_type::estimate),
+      threads(std::max(1u, std::thread::hardware_concurrency())),
+      png_level(3), png_filter(png_filter_type::adaptive),
+      wisdom(default_cache_path("wisdom")), jobs(2) {}
 
 static inline bool is_sane(double x) {
     return !(std::isnan(x) || std::isinf(x));
@@ -19,10 +44,75 @@ void options::check() {
         (boost::format("invalid value for '" #x "' - %d") % (x)).str())
 
     if (!is_sane(weight) || (weight <= 0.0)) { THROW_INVALID(weight); }
+    if (threads == 0) { THROW_INVALID(threads); }
+    if (png_level > 9) { THROW_INVALID(png_level); }
+    if (jobs == 0) { THROW_INVALID(jobs); }
+    if (!stats.empty() && stats != "json") {
+        throw option_error("unknown stats format: " + stats);
+    }
+    if (tile > 0 && method != method_type::nop &&
+        method != method_type::gaussian) {
+        throw option_error("tiling is not supported by method: " +
+                           get_method_str());
+    }
+    if (batched && method != method_type::nop &&
+        method != method_type::gaussian) {
+        throw option_error("batching is not supported by method: " +
+                           get_method_str());
+    }
+    if (batched && tile > 0) {
+        throw option_error("batching is not supported with tiling");
+    }
+    if (engine == engine_type::direct || engine == engine_type::recursive) {
+        if (method != method_type::gaussian) {
+            throw option_error(get_engine_str() +
+                               " engine is not supported by method: " +
+                               get_method_str());
+        }
+        if (tile > 0 || batched) {
+            throw option_error(
+                get_engine_str() +
+                " engine is not supported with tiling or batching");
+        }
+        if (analytic) {
+            throw option_error(get_engine_str() +
+                               " engine is not supported with an analytic "
+                               "kernel");
+        }
+    }
+    if (!serve.empty() && !files.empty()) {
+        throw option_error("input files are given by requests when serving");
+    }
 
 #undef THROW_INVALID
 }
 
+void options::read_manifest(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in) { throw option_error("cannot open manifest: " + filename); }
+    std::string line;
+    for (std::size_t lineno = 1; std::getline(in, line); lineno++) {
+        if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+        if (line.empty() || line[0] == '#') { continue; }
+        std::string input, output, rest;
+        if (const auto tab = line.find('\t'); tab != std::string::npos) {
+            input = line.substr(0, tab);
+            output = line.substr(tab + 1);
+        } else {
+            std::istringstream fields(line);
+            fields >> input >> output >> rest;
+        }
+        if (input.empty() || output.empty() || !rest.empty() ||
+            output.find('\t') != std::string::npos) {
+            throw option_error((boost::format("%s:%d: expected "
+                                              "\"input output\"") %
+                                   filename % lineno)
+                                   .str());
+        }
+        files.emplace_back(input, output);
+    }
+}
+
 namespace {
 const std::vector<std::pair<method_type, std::string>> method_strings = {
     {method_type::nop, "nop"},
@@ -30,6 +120,7 @@ const std::vector<std::pair<method_type, std::string>> method_strings = {
     {method_type::spectrum, "spectrum"},
     {method_type::downscale2x, "downscale2x"},
     {method_type::upscale2x, "upscale2x"},
+    {method_type::resize, "resize"},
 };
 }
 
@@ -53,3 +144,152 @@ std::string options::get_method_str() const {
     }
     return "<unknown>";
 }
+
+namespace {
+// parses "a<sep>b" of positive numbers, or "a" alone with b = 1 if b is
+// optional
+bool parse_pair(const std::string &s, const char sep, unsigned &a,
+    unsigned &b, const bool optional) {
+    const auto parse = [](const std::string &t, unsigned &v) {
+        if (t.empty() || t.size() > 9 ||
+            t.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        v = static_cast<unsigned>(std::stoul(t));
+        return v > 0;
+    };
+    const auto i = s.find(sep);
+    if (i == std::string::npos) {
+        b = 1;
+        return optional && parse(s, a);
+    }
+    return parse(s.substr(0, i), a) && parse(s.substr(i + 1), b);
+}
+} // namespace
+
+bool options::set_size_str(const std::string &s) {
+    unsigned a, b;
+    if (parse_pair(s, 'x', a, b, false)) {
+        size_width = a;
+        size_height = b;
+        return true;
+    }
+    if (parse_pair(s, '/', a, b, true)) {
+        size_width = size_height = 0;
+        scale_num = a;
+        scale_den = b;
+        return true;
+    }
+    return false;
+}
+
+std::string options::get_size_str() const {
+    if (size_width > 0) {
+        return std::to_string(size_width) + "x" + std::to_string(size_height);
+    }
+    return std::to_string(scale_num) + "/" + std::to_string(scale_den);
+}
+
+namespace {
+const std::vector<std::pair<engine_type, std::string>> engine_strings = {
+    {engine_type::automatic, "auto"},
+    {engine_type::fft, "fft"},
+    {engine_type::direct, "direct"},
+    {engine_type::recursive, "recursive"},
+};
+}
+
+bool options::set_engine_str(const std::string &s) {
+    for (const auto &it : engine_strings) {
+        if (s == it.second) {
+            engine = it.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string options::get_engine_str() const {
+    for (const auto &it : engine_strings) {
+        if (engine == it.first) { return it.second; }
+    }
+    return "<unknown>";
+}
+
+namespace {
+const std::vector<std::pair<precision_type, std::string>> precision_strings = {
+    {precision_type::float32, "float"},
+    {precision_type::float64, "double"},
+};
+}
+
+bool options::set_precision_str(const std::string &s) {
+    for (const auto &it : precision_strings) {
+        if (s == it.second) {
+            precision = it.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string options::get_precision_str() const {
+    for (const auto &it : precision_strings) {
+        if (precision == it.first) { return it.second; }
+    }
+    return "<unknown>";
+}
+
+namespace {
+const std::vector<std::pair<planner_type, std::string>> planner_strings = {
+    {planner_type::estimate, "estimate"},
+    {planner_type::measure, "measure"},
+    {planner_type::patient, "patient"},
+};
+}
+
+bool options::set_planner_str(const std::string &s) {
+    for (const auto &it : planner_strings) {
+        if (s == it.second) {
+            planner = it.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string options::get_planner_str() const {
+    for (const auto &it : planner_strings) {
+        if (planner == it.first) { return it.second; }
+    }
+    return "<unknown>";
+}
+
+namespace {
+const std::vector<std::pair<png_filter_type, std::string>>
+    png_filter_strings = {
+        {png_filter_type::none, "none"},
+        {png_filter_type::sub, "sub"},
+        {png_filter_type::up, "up"},
+        {png_filter_type::average, "average"},
+        {png_filter_type::paeth, "paeth"},
+        {png_filter_type::adaptive, "adaptive"},
+};
+}
+
+bool options::set_png_filter_str(const std::string &s) {
+    for (const auto &it : png_filter_strings) {
+        if (s == it.second) {
+            png_filter = it.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string options::get_png_filter_str() const {
+    for (const auto &it : png_filter_strings) {
+        if (png_filter == it.first) { return it.second; }
+    }
+    return "<unknown>";
+}
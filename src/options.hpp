@@ -2,6 +2,8 @@
 #define IMAGECONV_OPTIONS_HPP
 
 #include <string>
+#include <utility>
+#include <vector>
 
 enum class method_type {
     nop,
@@ -9,19 +11,91 @@ enum class method_type {
     spectrum,
     downscale2x,
     upscale2x,
+    resize,
+};
+
+enum class precision_type {
+    float32,
+    float64,
+};
+
+enum class planner_type {
+    estimate,
+    measure,
+    patient,
+};
+
+// how gaussian is convolved: by transforms, directly in the image domain,
+// by a recursive filter approximating it, or by whichever of the exact
+// ones a cost model expects to be faster
+enum class engine_type {
+    automatic,
+    fft,
+    direct,
+    recursive,
+};
+
+// the values of the fixed filters are their PNG filter types
+enum class png_filter_type {
+    none,
+    sub,
+    up,
+    average,
+    paeth,
+    adaptive,
 };
 
 struct options {
-    std::string input, output;
+    // input => output
+    std::vector<std::pair<std::string, std::string>> files;
     double weight;
+    bool analytic;
     unsigned extend;
+    unsigned tile; // tile transform size, 0 to transform the whole image
+    bool batched;  // transform the channels with one batched plan
     method_type method;
+    // the output of resize: this size if size_width > 0, otherwise the
+    // input size scaled by scale_num / scale_den
+    unsigned size_width, size_height;
+    unsigned scale_num, scale_den;
+    engine_type engine;
+    precision_type precision;
+    planner_type planner;
+    unsigned threads;
+    unsigned png_level;
+    png_filter_type png_filter;
+    std::string wisdom;
+    std::string kernel_cache; // directory, empty for none
+    std::string stats; // metrics format, empty for none
+    std::string serve; // socket to serve requests on, empty for none
+    unsigned jobs;     // requests served concurrently
 
     options();
 
     std::string get_method_str() const;
     bool set_method_str(const std::string &);
 
+    // "WxH" for a size, "p/q" or "p" for a factor
+    std::string get_size_str() const;
+    bool set_size_str(const std::string &);
+
+    std::string get_engine_str() const;
+    bool set_engine_str(const std::string &);
+
+    std::string get_precision_str() const;
+    bool set_precision_str(const std::string &);
+
+    std::string get_planner_str() const;
+    bool set_planner_str(const std::string &);
+
+    std::string get_png_filter_str() const;
+    bool set_png_filter_str(const std::string &);
+
+    // Appends the files listed in a manifest, one "input output" pair per
+    // line. Fields are separated by a tab if the line has one, otherwise by
+    // white space. Empty lines and lines starting with '#' are ignored.
+    void read_manifest(const std::string &filename);
+
     void check();
 };
 
@@ -0,0 +1,54 @@
+#ifndef IMAGECONV_PLANES_HPP
+#define IMAGECONV_PLANES_HPP
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+// Helpers for the code that walks the rows of planes and images.
+namespace planes {
+// Splits n rows into bands, one per thread up to one per row, and runs
+// f(band, begin, end) on them, band 0 on the calling thread.
+template<typename N, typename F>
+void parallel_bands(const N n, const unsigned threads, const F &f) {
+    const auto count = std::max<long long>(
+        1, std::min(static_cast<long long>(threads),
+               static_cast<long long>(n)));
+    const auto row = [n, count](const long long i) {
+        return static_cast<N>(static_cast<long long>(n) * i / count);
+    };
+    std::vector<std::future<void>> workers;
+    for (long long i = 1; i < count; i++) {
+        workers.push_back(std::async(std::launch::async, f,
+            static_cast<unsigned>(i), row(i), row(i + 1)));
+    }
+    f(0u, row(0), row(1));
+    for (auto &it : workers) {
+        it.get();
+    }
+}
+
+// the same for rows(begin, end), which needs no band index
+template<typename N, typename F>
+void parallel_rows(const N n, const unsigned threads, const F &rows) {
+    parallel_bands(n, threads,
+        [&rows](unsigned, const N begin, const N end) { rows(begin, end); });
+}
+
+// reflect the coordinate t into [0, n)
+template<typename N>
+N mirror(long t, const N n) {
+    const auto m = static_cast<long>(n);
+    for (;;) {
+        if (t < 0) {
+            t = -t;
+        } else if (t >= m) {
+            t = m * 2 - 1 - t;
+        } else {
+            return static_cast<N>(t);
+        }
+    }
+}
+} // namespace planes
+
+#endif // IMAGECONV_PLANES_HPP
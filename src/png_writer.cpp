@@ -0,0 +1,252 @@
+#include "png_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+namespace {
+constexpr std::size_t bpp = 3; // bytes per pixel
+constexpr std::size_t max_chunk = 1u << 20u;
+
+unsigned char paeth(const int a, const int b, const int c) {
+    const auto p = a + b - c;
+    const auto pa = std::abs(p - a), pb = std::abs(p - b),
+               pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) { return a; }
+    if (pb <= pc) { return b; }
+    return c;
+}
+
+// write the filter type and the filtered row of n bytes to out
+void filter_row(const png_filter_type type, const unsigned char *row,
+    const unsigned char *prev, const std::size_t n, unsigned char *out) {
+    out[0] = static_cast<unsigned char>(type);
+    auto *const dst = out + 1;
+    const auto first = std::min(bpp, n);
+    switch (type) {
+    case png_filter_type::none: std::copy_n(row, n, dst); break;
+    case png_filter_type::sub:
+        std::copy_n(row, first, dst);
+        for (auto i = first; i < n; i++) {
+            dst[i] = row[i] - row[i - bpp];
+        }
+        break;
+    case png_filter_type::up:
+        for (std::size_t i = 0; i < n; i++) {
+            dst[i] = row[i] - prev[i];
+        }
+        break;
+    case png_filter_type::average:
+        for (std::size_t i = 0; i < first; i++) {
+            dst[i] = row[i] - prev[i] / 2;
+        }
+        for (auto i = first; i < n; i++) {
+            dst[i] = row[i] - (row[i - bpp] + prev[i]) / 2;
+        }
+        break;
+    case png_filter_type::paeth:
+    case png_filter_type::adaptive:
+        for (std::size_t i = 0; i < first; i++) {
+            dst[i] = row[i] - prev[i];
+        }
+        for (auto i = first; i < n; i++) {
+            dst[i] = row[i] - paeth(row[i - bpp], prev[i], prev[i - bpp]);
+        }
+        break;
+    }
+}
+
+// the heuristic of libpng: the filter with the least sum of the residuals
+// taken as signed bytes
+std::size_t residual(const unsigned char *out, const std::size_t n) {
+    std::size_t sum = 0;
+    for (std::size_t i = 1; i <= n; i++) {
+        sum += out[i] < 128u ? out[i] : 256u - out[i];
+    }
+    return sum;
+}
+
+// a band of rows compressed into a raw deflate stream
+struct band {
+    std::vector<unsigned char> data;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    z_off_t length = 0;
+};
+
+void deflate_all(z_stream &z, const unsigned char *in, const std::size_t n,
+    const int flush, std::vector<unsigned char> &out) {
+    std::array<unsigned char, 65536> buf;
+    z.next_in = const_cast<Bytef *>(in);
+    z.avail_in = static_cast<uInt>(n);
+    do {
+        z.next_out = buf.data();
+        z.avail_out = static_cast<uInt>(buf.size());
+        if (deflate(&z, flush) == Z_STREAM_ERROR) {
+            throw std::runtime_error("deflate failed");
+        }
+        out.insert(out.end(), buf.data(), z.next_out);
+    } while (z.avail_out == 0);
+}
+
+// the rows from begin to end, the first row of pixels filtered against above
+band compress_band(const int level, const png_filter_type filter,
+    const unsigned char *pixels, const unsigned char *above,
+    const std::size_t n, const std::size_t row_size, const std::size_t begin,
+    const std::size_t end, const bool last) {
+    band result;
+    z_stream z{};
+    const auto strategy =
+        filter == png_filter_type::none ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+    if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+        throw std::runtime_error("deflate failed");
+    }
+    const std::vector<unsigned char> zeros(n);
+    std::vector<unsigned char> out(n + 1), trial(n + 1);
+    for (auto y = begin; y < end; y++) {
+        const auto *row = pixels + y * row_size;
+        const auto *prev = y > 0 ? row - row_size
+                           : above != nullptr ? above
+                                              : zeros.data();
+        if (filter != png_filter_type::adaptive) {
+            filter_row(filter, row, prev, n, out.data());
+        } else {
+            auto best = std::numeric_limits<std::size_t>::max();
+            for (const auto type :
+                {png_filter_type::none, png_filter_type::sub,
+                    png_filter_type::up, png_filter_type::average,
+                    png_filter_type::paeth}) {
+                filter_row(type, row, prev, n, trial.data());
+                if (const auto sum = residual(trial.data(), n); sum < best) {
+                    best = sum;
+                    out.swap(trial);
+                }
+            }
+        }
+        result.adler = adler32(result.adler, out.data(), out.size());
+        result.length += out.size();
+        // the bands before the last end on a byte boundary without the
+        // final block, so that their streams can be concatenated
+        const auto flush =
+            y + 1 < end ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+        deflate_all(z, out.data(), out.size(), flush, result.data);
+    }
+    if (begin == end) {
+        deflate_all(z, nullptr, 0, last ? Z_FINISH : Z_SYNC_FLUSH,
+            result.data);
+    }
+    deflateEnd(&z);
+    return result;
+}
+
+void put_u32(std::vector<unsigned char> &out, const std::uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<unsigned char>(v >> shift));
+    }
+}
+
+void write_chunk(std::ofstream &out, const char *type,
+    const unsigned char *data, const std::size_t n) {
+    std::vector<unsigned char> head;
+    put_u32(head, static_cast<std::uint32_t>(n));
+    head.insert(head.end(), type, type + 4);
+    auto crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, head.data() + 4, 4);
+    if (n > 0) { crc = crc32(crc, data, static_cast<uInt>(n)); }
+    std::vector<unsigned char> tail;
+    put_u32(tail, static_cast<std::uint32_t>(crc));
+    out.write(reinterpret_cast<const char *>(head.data()), head.size());
+    out.write(reinterpret_cast<const char *>(data), n);
+    out.write(reinterpret_cast<const char *>(tail.data()), tail.size());
+}
+
+void write_idat(std::ofstream &out, const std::vector<unsigned char> &data) {
+    for (std::size_t i = 0; i < data.size(); i += max_chunk) {
+        write_chunk(out, "IDAT", data.data() + i,
+            std::min(max_chunk, data.size() - i));
+    }
+}
+} // namespace
+
+png_writer::png_writer(
+    const int level, const png_filter_type filter, const unsigned threads)
+    : level(level), filter(filter), threads(std::max(1u, threads)) {}
+
+void png_writer::write(const std::string &filename,
+    const unsigned char *pixels, const std::size_t width,
+    const std::size_t height, const std::size_t row_size) const {
+    png_band_writer out(filename, *this, width, height);
+    out.write(pixels, height, row_size);
+}
+
+png_band_writer::png_band_writer(std::string name, const png_writer &writer,
+    const std::size_t width, const std::size_t height)
+    : writer(writer), filename(std::move(name)), width(width),
+      height(height), out(filename, std::ios::binary),
+      adler(adler32(0L, Z_NULL, 0)), rows(0) {
+    static const unsigned char signature[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+    std::vector<unsigned char> header;
+    put_u32(header, static_cast<std::uint32_t>(width));
+    put_u32(header, static_cast<std::uint32_t>(height));
+    // 8-bit RGB, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    write_chunk(out, "IHDR", header.data(), header.size());
+
+    // zlib header with a 32K window and the level hint
+    const auto level = writer.level;
+    const unsigned flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    const unsigned cmf = 0x78, flg = flevel << 6u;
+    const auto check = (31 - (cmf * 256 + flg) % 31) % 31;
+    data = {static_cast<unsigned char>(cmf),
+        static_cast<unsigned char>(flg + check)};
+}
+
+void png_band_writer::write(const unsigned char *pixels,
+    const std::size_t count, const std::size_t row_size) {
+    if (count > height - rows) {
+        throw std::logic_error("too many rows for png file: " + filename);
+    }
+    const auto n = width * bpp;
+    const auto last = rows + count == height;
+    const auto bands = std::max<std::size_t>(
+        1, std::min<std::size_t>(writer.threads, count));
+    std::vector<std::future<band>> workers;
+    for (std::size_t i = 0; i < bands; i++) {
+        workers.push_back(std::async(std::launch::async, compress_band,
+            writer.level, writer.filter, pixels,
+            above.empty() ? nullptr : above.data(), n, row_size,
+            count * i / bands, count * (i + 1) / bands,
+            last && i + 1 == bands));
+    }
+    for (auto &it : workers) {
+        const auto b = it.get();
+        adler = adler32_combine(adler, b.adler, b.length);
+        data.insert(data.end(), b.data.begin(), b.data.end());
+        if (data.size() >= max_chunk) {
+            write_idat(out, data);
+            data.clear();
+        }
+    }
+    rows += count;
+    if (count > 0) {
+        const auto *const row = pixels + (count - 1) * row_size;
+        above.assign(row, row + n);
+    }
+    if (!last) { return; }
+    put_u32(data, static_cast<std::uint32_t>(adler));
+    write_idat(out, data);
+    write_chunk(out, "IEND", nullptr, 0);
+    if (!out.flush()) {
+        throw std::runtime_error("failed to write png file: " + filename);
+    }
+}
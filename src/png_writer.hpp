@@ -0,0 +1,52 @@
+#ifndef IMAGECONV_PNG_WRITER_HPP
+#define IMAGECONV_PNG_WRITER_HPP
+
+#include "options.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes 8-bit RGB rows as a PNG file. The rows are filtered and deflated in
+// independent bands, one per thread, and the raw deflate streams of the
+// bands are joined into a single zlib stream as pigz does. With one thread
+// the output is an ordinary single-stream PNG.
+class png_writer final {
+    const int level;
+    const png_filter_type filter;
+    const unsigned threads;
+
+public:
+    png_writer(int level, png_filter_type filter, unsigned threads);
+
+    void write(const std::string &filename, const unsigned char *pixels,
+        std::size_t width, std::size_t height, std::size_t row_size) const;
+
+    friend class png_band_writer;
+};
+
+// Writes a PNG file band by band as its rows are finished, so that only
+// a band of the 8-bit image is held at a time. Each band is split and
+// deflated on the threads of the writer like a whole image.
+class png_band_writer final {
+    const png_writer writer;
+    const std::string filename;
+    const std::size_t width, height;
+    std::ofstream out;
+    std::vector<unsigned char> data, above; // pending IDAT, the last row
+    unsigned long adler;
+    std::size_t rows; // written so far
+
+public:
+    png_band_writer(std::string filename, const png_writer &writer,
+        std::size_t width, std::size_t height);
+
+    // the next rows of the image; the file is complete after the last
+    void write(
+        const unsigned char *pixels, std::size_t count, std::size_t row_size);
+
+    [[nodiscard]] bool done() const { return rows == height; }
+};
+
+#endif // IMAGECONV_PNG_WRITER_HPP
@@ -0,0 +1,273 @@
+#include "server.hpp"
+#include "option_error.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+constexpr std::size_t max_line = 65536;
+constexpr int idle_seconds = 60;
+
+template<typename T>
+T parse(const std::string &name, const std::string &value) {
+    try {
+        return boost::lexical_cast<T>(value);
+    } catch (const boost::bad_lexical_cast &) {
+        throw option_error("invalid value for '" + name + "' - " + value);
+    }
+}
+
+// apply the options of a request to op and return its input and output
+std::tuple<std::string, std::string> parse_request(
+    const std::string &line, options &op) {
+    std::vector<std::string> fields;
+    if (line.find('\t') != std::string::npos) {
+        std::istringstream in(line);
+        for (std::string field; std::getline(in, field, '\t');) {
+            fields.push_back(field);
+        }
+    } else {
+        std::istringstream in(line);
+        for (std::string field; in >> field;) {
+            fields.push_back(field);
+        }
+    }
+    if (fields.size() < 2 || fields[0].empty() || fields[1].empty()) {
+        throw option_error("expected \"input output [name=value]...\"");
+    }
+    std::string method, precision;
+    for (std::size_t i = 2; i < fields.size(); i++) {
+        const auto &field = fields[i];
+        const auto eq = field.find('=');
+        if (eq == std::string::npos) {
+            throw option_error("expected name=value: " + field);
+        }
+        const auto name = field.substr(0, eq), value = field.substr(eq + 1);
+        if (name == "method") {
+            method = value;
+        } else if (name == "precision") {
+            precision = value;
+        } else if (name == "weight") {
+            op.weight = parse<double>(name, value);
+        } else if (name == "analytic") {
+            op.analytic = parse<bool>(name, value);
+        } else if (name == "extend") {
+            op.extend = parse<unsigned>(name, value);
+        } else if (name == "size") {
+            if (!op.set_size_str(value)) {
+                throw option_error("invalid size: " + value);
+            }
+        } else {
+            throw option_error("unknown option: " + name);
+        }
+    }
+    // as on the command line, a method may override the extend given
+    if (!method.empty() && !op.set_method_str(method)) {
+        throw option_error("unknown method: " + method);
+    }
+    if (!precision.empty() && !op.set_precision_str(precision)) {
+        throw option_error("unknown precision: " + precision);
+    }
+    op.check();
+    return {fields[0], fields[1]};
+}
+
+// a client that went away must not raise SIGPIPE
+bool send_line(const int conn, const std::string &line) {
+    const auto data = line + '\n';
+    for (std::size_t i = 0; i < data.size();) {
+        const auto n =
+            ::send(conn, data.data() + i, data.size() - i, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+[[noreturn]] void fail(const std::string &what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+server::server(const options &op)
+    : op(op), conv(op), fd(-1), stopping(false) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (op.serve.size() >= sizeof(addr.sun_path)) {
+        throw option_error("socket path is too long: " + op.serve);
+    }
+    std::copy(op.serve.begin(), op.serve.end(), addr.sun_path);
+    // a socket left by a previous server is replaced
+    struct stat st {};
+    if (::lstat(op.serve.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(op.serve.c_str());
+    }
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { fail("socket"); }
+    if (::bind(fd, reinterpret_cast<const sockaddr *>(&addr),
+            sizeof(addr)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        const auto err = errno;
+        ::close(fd);
+        errno = err;
+        fail("failed to listen on " + op.serve);
+    }
+}
+
+server::~server() {
+    ::close(fd);
+    ::unlink(op.serve.c_str());
+}
+
+std::string server::handle(const std::string &line) {
+    auto job = op;
+    job.serve.clear();
+    job.threads = std::max(1u, op.threads / op.jobs);
+    try {
+        const auto [input, output] = parse_request(line, job);
+        return "ok " + conv.convert(job, input, output);
+    } catch (const std::exception &ex) {
+        std::cerr << "error: " << line << ": " << ex.what() << std::endl;
+        return std::string("error ") + ex.what();
+    }
+}
+
+std::string server::submit(const std::string &line) {
+    std::packaged_task<std::string()> task(
+        [this, line] { return handle(line); });
+    auto reply = task.get_future();
+    {
+        // a full queue holds the connection back rather than the workers
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] {
+            return stopping || queue.size() < op.jobs * std::size_t(4);
+        });
+        if (stopping) { return "error server is stopping"; }
+        queue.push_back(std::move(task));
+    }
+    changed.notify_all();
+    return reply.get();
+}
+
+void server::serve_queue() {
+    for (;;) {
+        std::packaged_task<std::string()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) { return; }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        changed.notify_all();
+        task();
+    }
+}
+
+void server::session(const int conn) {
+    std::string buf;
+    char chunk[4096];
+    for (;;) {
+        std::size_t eol;
+        while ((eol = buf.find('\n')) == std::string::npos) {
+            if (buf.size() > max_line) {
+                send_line(conn, "error request too long");
+                return;
+            }
+            // a timeout ends an idle connection
+            const auto n = ::read(conn, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { return; }
+            buf.append(chunk, n);
+        }
+        auto line = buf.substr(0, eol);
+        buf.erase(0, eol + 1);
+        if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+        if (line.empty()) { continue; }
+        if (!send_line(conn, submit(line))) { return; }
+    }
+}
+
+void server::run() {
+    std::vector<std::future<void>> workers;
+    for (unsigned i = 0; i < op.jobs; i++) {
+        workers.push_back(
+            std::async(std::launch::async, [this] { serve_queue(); }));
+    }
+    std::exception_ptr error;
+    for (;;) {
+        const int conn = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            // out of descriptors or memory for now, try again shortly
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+                errno == ENOMEM) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            error = std::make_exception_ptr(std::system_error(
+                errno, std::generic_category(), "accept"));
+            break;
+        }
+        const timeval timeout{idle_seconds, 0};
+        ::setsockopt(
+            conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            sessions.insert(conn);
+        }
+        const auto end = [this, conn] {
+            const std::lock_guard<std::mutex> lock(mutex);
+            ::close(conn);
+            sessions.erase(conn);
+            changed.notify_all();
+        };
+        try {
+            std::thread([this, conn, end] {
+                session(conn);
+                end();
+            }).detach();
+        } catch (const std::system_error &) {
+            // no thread to spare, drop the connection and carry on
+            end();
+        }
+    }
+
+    // wake the connections still open and wait for them to end
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+        changed.notify_all();
+    }
+    for (auto &it : workers) {
+        it.get();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (const auto conn : sessions) {
+            ::shutdown(conn, SHUT_RDWR);
+        }
+        changed.wait(lock, [this] { return sessions.empty(); });
+    }
+    std::rethrow_exception(error);
+}
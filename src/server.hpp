@@ -0,0 +1,53 @@
+#ifndef IMAGECONV_SERVER_HPP
+#define IMAGECONV_SERVER_HPP
+
+#include "imageconv.hpp"
+#include "options.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+
+// Serves conversions over a Unix stream socket, so that the plans, kernels
+// and buffers stay warm from one request to the next. Each line of
+// a connection is a request, "input output [name=value]...", with the
+// fields separated by tabs if the line has one, otherwise by white space.
+// The names are method, weight, analytic, extend, size and precision; the
+// rest of the options are those of the server. Each request is answered by
+// one line, "ok" and the metrics of the file as JSON, or "error" and the
+// reason. Every connection is read on a thread of its own, and the requests
+// of all of them wait in one bounded queue for op.jobs workers, each with
+// its share of the threads. A connection idle for a minute is closed.
+class server final {
+    const options &op;
+    imageconv conv;
+    int fd;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::packaged_task<std::string()>> queue;
+    std::set<int> sessions;
+    bool stopping;
+
+    std::string handle(const std::string &line);
+    // queue a request and wait for its reply
+    std::string submit(const std::string &line);
+    void serve_queue();
+    void session(int conn);
+
+public:
+    explicit server(const options &op);
+
+    server(const server &) = delete;
+    server &operator=(const server &) = delete;
+
+    ~server();
+
+    // serves until accepting fails for other than a lack of resources
+    void run();
+};
+
+#endif // IMAGECONV_SERVER_HPP
@@ -0,0 +1,76 @@
+#include "stats.hpp"
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include <cstdio>
+#include <sstream>
+
+namespace {
+std::int64_t thread_cpu_ns() {
+    struct timespec ts {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+std::string quote(const std::string &s) {
+    std::string out = "\"";
+    for (const auto ch : s) {
+        switch (ch) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                out += buf;
+            } else {
+                out += ch;
+            }
+            break;
+        }
+    }
+    return out + "\"";
+}
+} // namespace
+
+std::string stage_time::to_json() const {
+    std::ostringstream out;
+    out << "{\"wall_ms\":" << wall_ns / 1e6 << ",\"cpu_ms\":" << cpu_ns / 1e6
+        << "}";
+    return out.str();
+}
+
+stage_timer::stage_timer(stage_time &stage)
+    : stage(stage), begin(std::chrono::steady_clock::now()),
+      cpu_begin(thread_cpu_ns()) {}
+
+stage_timer::~stage_timer() {
+    const auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin);
+    stage.add(wall.count(), thread_cpu_ns() - cpu_begin);
+}
+
+std::string file_stats::to_json() const {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    std::ostringstream out;
+    out << "{\"input\":" << quote(input) << ",\"output\":" << quote(output)
+        << ",\"width\":" << width << ",\"height\":" << height
+        << ",\"transform_width\":" << w << ",\"transform_height\":" << h
+        << ",\"engine\":" << quote(engine)
+        << ",\"stages\":{\"decode\":" << decode.to_json()
+        << ",\"kernel\":" << kernel.to_json()
+        << ",\"forward\":" << forward.to_json()
+        << ",\"multiply\":" << multiply.to_json()
+        << ",\"inverse\":" << inverse.to_json()
+        << ",\"convolve\":" << convolve.to_json()
+        << ",\"render\":" << render.to_json()
+        << ",\"encode\":" << encode.to_json()
+        << ",\"write\":" << write.to_json() << "}"
+        << ",\"forward_flops\":" << forward_flops
+        << ",\"inverse_flops\":" << inverse_flops
+        << ",\"fft_bytes\":" << fft_bytes
+        << ",\"peak_rss_kib\":" << usage.ru_maxrss << "}";
+    return out.str();
+}
@@ -0,0 +1,54 @@
+#ifndef IMAGECONV_STATS_HPP
+#define IMAGECONV_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Wall and CPU time of a stage, summed over the threads that ran it, so
+// stages running concurrently can add up to more than the elapsed time. The
+// CPU time is that of the calling threads and leaves out FFTW's own threads.
+class stage_time final {
+    std::atomic<std::int64_t> wall_ns{0}, cpu_ns{0};
+
+public:
+    void add(std::int64_t wall, std::int64_t cpu) {
+        wall_ns += wall;
+        cpu_ns += cpu;
+    }
+
+    std::string to_json() const;
+};
+
+// adds the time from its construction to its destruction to a stage
+class stage_timer final {
+    stage_time &stage;
+    const std::chrono::steady_clock::time_point begin;
+    const std::int64_t cpu_begin;
+
+public:
+    explicit stage_timer(stage_time &stage);
+
+    stage_timer(const stage_timer &) = delete;
+    stage_timer &operator=(const stage_timer &) = delete;
+
+    ~stage_timer();
+};
+
+// the metrics of one converted file
+struct file_stats {
+    std::string input, output;
+    std::size_t width = 0, height = 0; // image size
+    std::size_t w = 0, h = 0;          // transform size, 0 for none
+    std::string engine = "fft";
+    stage_time decode, kernel, forward, multiply, inverse, convolve, render,
+        encode, write;
+    double forward_flops = 0.0, inverse_flops = 0.0; // per transform
+    std::size_t fft_bytes = 0; // allocated through fft::new_buffer
+
+    // one line of JSON, including the peak RSS of the process so far
+    std::string to_json() const;
+};
+
+#endif // IMAGECONV_STATS_HPP
@@ -0,0 +1,181 @@
+#include <array>
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../fft.hpp"
+#include "../image.hpp"
+#include "../kernel.hpp"
+#include "../methods.hpp"
+
+// Times the hot kernels over a range of sizes and prints one CSV row per
+// kernel and size. The sizes are the arguments, or a default range.
+// Bandwidth counts the bytes each kernel has to read and write once.
+
+namespace {
+using namespace std;
+
+template<typename T>
+const char *type_name();
+template<>
+const char *type_name<float>() {
+    return "float";
+}
+template<>
+const char *type_name<double>() {
+    return "double";
+}
+
+// repeat f for at least 100 ms and report its average time
+template<typename T, typename F>
+void run(const char *name, const size_t w, const size_t h,
+    const double bytes, F &&f) {
+    using clock = chrono::steady_clock;
+    f(); // warm up
+    size_t iterations = 0;
+    const auto begin = clock::now();
+    chrono::nanoseconds elapsed{};
+    do {
+        f();
+        iterations++;
+        elapsed = clock::now() - begin;
+    } while (elapsed < chrono::milliseconds(100));
+    const auto ns = static_cast<double>(elapsed.count()) / iterations;
+    printf("%s,%s,%zu,%zu,%zu,%.4f,%.4f\n", name, type_name<T>(), w, h,
+        iterations, ns / (w * h), bytes / ns);
+    fflush(stdout);
+}
+
+template<typename T>
+void bench(const size_t w, const size_t h) {
+    using C = complex<T>;
+    mt19937_64 mt(w * h);
+    uniform_real_distribution<T> dist(0, 1);
+    const auto n = fft<T>::buffer_size(w, h);
+    const auto stride = fft<T>::real_stride(w);
+    const auto cs = sizeof(C), ts = sizeof(T);
+    const auto pixels = static_cast<double>(w * h);
+
+    array<shared_ptr<C>, 3> c;
+    for (auto &it : c) {
+        it = fft<T>::new_buffer(n);
+        auto *r = fft<T>::real(it);
+        for (size_t i = 0; i < n * 2; i++) {
+            r[i] = dist(mt);
+        }
+    }
+    // unit coefficients keep repeated products finite
+    const auto k = fft<T>::new_buffer(n);
+    for (size_t i = 0; i < n; i++) {
+        k.get()[i] = polar<T>(1, dist(mt) * 6);
+    }
+
+    fft<T> forward(w, h, false);
+    fft<T> backward(w, h, true);
+    run<T>("fft_forward", w, h, n * cs * 2.0,
+        [&] { forward.compute(c[0]); });
+    run<T>("fft_backward", w, h, n * cs * 2.0,
+        [&] { backward.compute(c[0]); });
+    run<T>("multiply", w, h, n * cs * 3.0,
+        [&] { methods::multiply(c[1].get(), k.get(), n); });
+
+    {
+        const auto wh = static_cast<int>(w * h);
+        vector<C> a(wh), t(wh);
+        run<T>("fftshift", w, h, wh * cs * 4.0, [&] {
+            methods::fftshift(a.data(), t.data(), w, h);
+        });
+    }
+    {
+        const auto n1 = fft<T>::buffer_size(w / 2, h / 2);
+        auto dst = fft<T>::new_buffer(n1);
+        run<T>("downsample2x", w, h, n1 * cs * 2.0, [&] {
+            methods::downsample2x(dst.get(), c[1].get(), w, h);
+        });
+        run<T>("downsample2x_fused", w, h, n1 * cs * 3.0, [&] {
+            methods::downsample2x(dst.get(), c[1].get(), k.get(), w, h);
+        });
+    }
+    {
+        const auto n1 = fft<T>::buffer_size(w * 2, h * 2);
+        auto dst = fft<T>::new_buffer(n1);
+        run<T>("upsample2x", w, h, (n + n1) * cs * 1.0, [&] {
+            methods::upsample2x(dst.get(), c[1].get(), w, h);
+        });
+    }
+    {
+        vector<T> r(stride * h), g(stride * h), b(stride * h);
+        run<T>("spectrum", w, h, n * cs * 3.0 + pixels * ts * 3.0, [&] {
+            methods::spectrum(r.data(), g.data(), b.data(), stride,
+                c[0].get(), c[1].get(), c[2].get(), w, h);
+        });
+    }
+
+    {
+        constexpr int radius = 40; // the default weight
+        vector<T> plane(stride * h), tmp(stride * h), taps(radius + 1);
+        kernel::gaussian_taps(taps.data(), radius, 10.0);
+        run<T>("convolve_direct", w, h, pixels * ts * 4.0, [&] {
+            methods::convolve(plane.data(), tmp.data(), w, h, stride,
+                taps.data(), radius);
+        });
+    }
+
+    auto *real = fft<T>::real(c[2]);
+    run<T>("kernel_identity", w, h, pixels * ts,
+        [&] { kernel::identity(real, w, h, stride); });
+    run<T>("kernel_gaussian", w, h, pixels * ts,
+        [&] { kernel::gaussian(real, w, h, stride, 10.0); });
+    run<T>("kernel_gaussian_spectrum", w, h, n * cs,
+        [&] { kernel::gaussian_spectrum(c[2].get(), w, h, 10.0); });
+    run<T>("kernel_mitchell", w, h, pixels * ts,
+        [&] { kernel::mitchell(real, w, h, stride, 2.0); });
+    run<T>("kernel_mitchell_spectrum", w, h,
+        fft<T>::buffer_size(w / 2, h / 2) * cs, [&] {
+            kernel::mitchell_spectrum(c[2].get(), w, h, 2.0, w / 2, h / 2);
+        });
+    run<T>("kernel_lanczos", w, h, pixels * ts,
+        [&] { kernel::lanczos(real, w, h, stride, 2.0, 10); });
+
+    {
+        constexpr unsigned extend = 16;
+        const auto iw = w - extend * 2, ih = h - extend * 2;
+        image img(iw, ih);
+        auto *r = fft<T>::real(c[0]), *g = fft<T>::real(c[1]),
+             *b = fft<T>::real(c[2]);
+        for (size_t i = 0; i < n * 2; i++) {
+            r[i] = g[i] = b[i] = dist(mt);
+        }
+        run<T>("image_save_extended", w, h, iw * ih * (ts + 1) * 3.0,
+            [&] { img.save_extended(extend, r, g, b, stride); });
+        run<T>("image_load_extended", w, h, pixels * (ts + 1) * 3.0,
+            [&] { img.load_extended(extend, w, h, r, g, b, stride); });
+    }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) { sizes = {256, 512, 1024, 2048}; }
+    printf("benchmark,type,width,height,iterations,ns_per_pixel,gb_per_s\n");
+    for (const auto size : sizes) {
+        if (size < 64 || size % 4 != 0) {
+            fprintf(stderr, "size must be a multiple of 4 from 64: %zu\n",
+                size);
+            return EXIT_FAILURE;
+        }
+        bench<float>(size, size);
+        bench<double>(size, size);
+    }
+    fft<float>::cleanup();
+    fft<double>::cleanup();
+    return EXIT_SUCCESS;
+}
@@ -1,15 +1,269 @@
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include "../kernel.hpp"
+#include "../methods.hpp"
 
 int main() {
     using namespace std;
 
     const int w = 16, h = 16;
-    auto k = new std::complex<double>[w * h];
-    kernel::lanczos(k, w, h, 2.0, 10);
+    auto k = new double[w * h];
+    kernel::lanczos(k, w, h, w, 2.0, 10);
+
+    auto gaussian_spectrum_check = [](int w, int h, double weight) {
+        const int cw = w / 2 + 1;
+        auto *spatial = new double[w * h];
+        auto *spectrum = new complex<double>[cw * h];
+        kernel::gaussian(spatial, w, h, w, weight);
+        kernel::gaussian_spectrum(spectrum, w, h, weight);
+        for (int v = 0; v < h; v++) {
+            for (int u = 0; u < cw; u++) {
+                complex<double> dft = 0;
+                for (int y = 0; y < h; y++) {
+                    for (int x = 0; x < w; x++) {
+                        const auto phase = -2.0 * M_PI *
+                                           (static_cast<double>(u) * x / w +
+                                               static_cast<double>(v) * y / h);
+                        dft += spatial[y * w + x] * polar(1.0, phase);
+                    }
+                }
+                if (abs(dft - spectrum[v * cw + u]) * (w * h) > 1e-6) {
+                    printf("fail on w=%d h=%d weight=%g\n", w, h, weight);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        delete[] spatial, delete[] spectrum;
+    };
+    gaussian_spectrum_check(32, 32, 2.0);
+    gaussian_spectrum_check(33, 30, 2.5);
+    gaussian_spectrum_check(48, 35, 0.5);
+
+    auto precision_check = [](int w, int h, double weight) {
+        const int cw = w / 2 + 1;
+        auto *f32 = new complex<float>[cw * h];
+        auto *f64 = new complex<double>[cw * h];
+        kernel::gaussian_spectrum(f32, w, h, weight);
+        kernel::gaussian_spectrum(f64, w, h, weight);
+        for (int i = 0; i < cw * h; i++) {
+            if (abs(complex<double>(f32[i]) - f64[i]) > abs(f64[0]) * 1e-6) {
+                printf("fail on float w=%d h=%d weight=%g\n", w, h, weight);
+                exit(EXIT_FAILURE);
+            }
+        }
+        delete[] f32, delete[] f64;
+    };
+    precision_check(32, 24, 3.0);
+
+    // the kernels built from tables against the plane evaluated directly
+    auto plane_check = [](int w, int h, double param, unsigned threads) {
+        const int stride = w + 2;
+        const auto axis = [](int v, int n) { return v < n / 2 ? v : v - n; };
+        auto *gaussian = new double[stride * h];
+        auto *mitchell = new double[stride * h];
+        kernel::gaussian(gaussian, w, h, stride, param, threads);
+        kernel::mitchell(mitchell, w, h, stride, param, threads);
+        auto *expected = new double[w * h];
+        for (int pass = 0; pass < 2; pass++) {
+            const auto *got = pass == 0 ? gaussian : mitchell;
+            auto sum = 0.0;
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    const double dx = axis(x, w), dy = axis(y, h);
+                    auto &v = expected[y * w + x];
+                    if (pass == 0) {
+                        v = exp(-(dx * dx + dy * dy) / (2.0 * param * param));
+                    } else {
+                        const auto d = hypot(dx, dy) / param;
+                        const auto b = 1.0 / 3.0, c = 1.0 / 3.0;
+                        v = d < 1.0 ? ((12 - 9 * b - 6 * c) * d * d * d +
+                                          (-18 + 12 * b + 6 * c) * d * d +
+                                          (6 - 2 * b)) /
+                                          6.0
+                            : d < 2.0
+                                ? ((-b - 6 * c) * d * d * d +
+                                      (6 * b + 30 * c) * d * d +
+                                      (-12 * b - 48 * c) * d +
+                                      (8 * b + 24 * c)) /
+                                      6.0
+                                : 0.0;
+                    }
+                    sum += v;
+                }
+            }
+            for (int i = 0; i < w * h; i++) {
+                const auto v = expected[i] / (sum * w * h);
+                const auto g = got[i / w * stride + i % w];
+                if (abs(g - v) > 1e-12 / (w * h)) {
+                    printf("fail on %s w=%d h=%d param=%g\n",
+                        pass == 0 ? "gaussian" : "mitchell", w, h, param);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        delete[] gaussian, delete[] mitchell, delete[] expected;
+    };
+    plane_check(16, 16, 2.0, 1);
+    plane_check(33, 30, 3.3, 4);
+    plane_check(5, 7, 0.5, 3);
+    plane_check(1, 1, 2.0, 2);
+
+    // each axis on its own scale, an impulse where it is not downscaled
+    auto separable_check = [](int w, int h, double sx, double sy) {
+        const int stride = w + 2;
+        const auto axis = [](int v, int n) { return v < n / 2 ? v : v - n; };
+        const auto mitchell = [](double d) {
+            d = abs(d);
+            return d < 1.0 ? (7 * d * d * d - 12 * d * d + 16.0 / 3) / 6.0
+                 : d < 2.0 ? (-7.0 / 3 * d * d * d + 12 * d * d - 20 * d +
+                                32.0 / 3) /
+                                 6.0
+                           : 0.0;
+        };
+        const auto tap = [&mitchell](int d, double scale) {
+            return scale > 1.0 ? mitchell(d / scale) : d == 0 ? 1.0 : 0.0;
+        };
+        auto *k = new double[stride * h];
+        kernel::mitchell_separable(k, w, h, stride, sx, sy, 2);
+        vector<double> expected(w * h);
+        auto sum = 0.0;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                expected[y * w + x] = tap(axis(x, w), sx) * tap(axis(y, h), sy);
+                sum += expected[y * w + x];
+            }
+        }
+        for (int i = 0; i < w * h; i++) {
+            const auto v = expected[i] / (sum * w * h);
+            if (abs(k[i / w * stride + i % w] - v) > 1e-12 / (w * h)) {
+                printf("fail on separable mitchell w=%d h=%d sx=%g sy=%g\n",
+                    w, h, sx, sy);
+                exit(EXIT_FAILURE);
+            }
+        }
+        delete[] k;
+    };
+    separable_check(32, 24, 2.0, 2.0);
+    separable_check(40, 30, 4.5, 1.0);
+    separable_check(17, 33, 0.5, 3.25);
+
+    // the corners of the transformed plane that downsample2x keeps
+    auto mitchell_spectrum_check = [](int w, int h, double scale) {
+        const int cw = w / 2 + 1, w1 = w / 2, h1 = h / 2;
+        const int n1 = (w1 / 2 + 1) * h1;
+        vector<double> spatial(w * h);
+        vector<complex<double>> full(cw * h), expected(n1), got(n1);
+        kernel::mitchell(spatial.data(), w, h, w, scale);
+        for (int v = 0; v < h; v++) {
+            for (int u = 0; u < cw; u++) {
+                for (int y = 0; y < h; y++) {
+                    for (int x = 0; x < w; x++) {
+                        const auto phase = -2.0 * M_PI *
+                                           (static_cast<double>(u) * x / w +
+                                               static_cast<double>(v) * y / h);
+                        full[v * cw + u] +=
+                            spatial[y * w + x] * polar(1.0, phase);
+                    }
+                }
+            }
+        }
+        methods::downsample2x(expected.data(), full.data(), w, h);
+        kernel::mitchell_spectrum(got.data(), w, h, scale, w1, h1, 3);
+        for (int i = 0; i < n1; i++) {
+            if (abs(got[i] - expected[i]) * (w * h) > 1e-9) {
+                printf("fail on mitchell spectrum w=%d h=%d scale=%g\n", w,
+                    h, scale);
+                exit(EXIT_FAILURE);
+            }
+        }
+    };
+    mitchell_spectrum_check(32, 24, 2.0);
+    mitchell_spectrum_check(30, 22, 2.0);
+    mitchell_spectrum_check(8, 6, 2.0);
+    mitchell_spectrum_check(36, 28, 1.5);
+
+    auto lanczos_check = [](int w, int h, int a) {
+        const int stride = w + 2;
+        auto *k = new double[stride * h];
+        kernel::lanczos(k, w, h, stride, 2.0, a, 2);
+        auto sum = 0.0;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const auto v = k[y * stride + x];
+                const auto far = min(x, w - x) > a || min(y, h - y) > a;
+                if (!isfinite(v) || (far && v != 0.0) ||
+                    v != k[(h - y) % h * stride + (w - x) % w]) {
+                    printf("fail on lanczos w=%d h=%d\n", w, h);
+                    exit(EXIT_FAILURE);
+                }
+                sum += v;
+            }
+        }
+        if (abs(sum * w * h - 1.0) > 1e-12) {
+            printf("fail on lanczos sum w=%d h=%d\n", w, h);
+            exit(EXIT_FAILURE);
+        }
+        delete[] k;
+    };
+    lanczos_check(32, 24, 10);
+    lanczos_check(64, 64, 3);
+
+    // the impulse response of the recursive gaussian against the kernel,
+    // away from the borders and within the error of the approximation
+    auto recursive_check = [](auto zero, int w, int h, double weight,
+                               unsigned threads) {
+        using T = decltype(zero);
+        const int stride = w + 3;
+        auto *plane = new T[stride * h]();
+        auto *k = new double[w * h];
+        const int cx = w / 2, cy = h / 3;
+        plane[cy * stride + cx] = 1;
+        methods::recursive_gaussian(plane, w, h, stride, weight, threads);
+        kernel::gaussian(k, w, h, w, weight);
+        const auto peak = k[0] * w * h;
+        auto error = 0.0;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const auto v = k[(y - cy + h) % h * w + (x - cx + w) % w];
+                error = max(error, abs(plane[y * stride + x] - v * w * h));
+            }
+        }
+        // about 1 % of the peak along each axis, more for small weights
+        if (!(error <= peak * (weight < 5.0 ? 0.05 : 0.025))) {
+            printf("fail on recursive w=%d h=%d weight=%g\n", w, h, weight);
+            exit(EXIT_FAILURE);
+        }
+        delete[] plane, delete[] k;
+    };
+    recursive_check(0.0, 64, 96, 2.0, 1);
+    recursive_check(0.0, 128, 150, 10.0, 3);
+    recursive_check(0.0, 257, 200, 20.0, 2);
+    recursive_check(0.0, 64, 64, 0.8, 2);
+    recursive_check(0.0, 400, 480, 40.0, 2);
+    recursive_check(0.0f, 1000, 1200, 100.0, 2);
+
+    // the borders extend a flat plane by itself, at any weight and size
+    auto recursive_flat_check = [](auto zero, int w, int h, double weight) {
+        using T = decltype(zero);
+        vector<T> plane(w * h, T(0.5));
+        methods::recursive_gaussian(plane.data(), w, h, w, weight, 2);
+        for (const auto v : plane) {
+            if (!(abs(v - T(0.5)) <= 1e-5)) {
+                printf("fail on recursive flat w=%d h=%d weight=%g\n", w, h,
+                    weight);
+                exit(EXIT_FAILURE);
+            }
+        }
+    };
+    recursive_flat_check(0.0f, 37, 23, 100.0);
+    recursive_flat_check(0.0f, 64, 48, 400.0);
+    recursive_flat_check(0.0, 1, 2, 10.0);
+    recursive_flat_check(0.0f, 3, 1, 0.3);
 
     return 0;
 }
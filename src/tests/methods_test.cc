@@ -1,6 +1,9 @@
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include "../methods.hpp"
 
@@ -30,5 +33,255 @@ int main() {
     fftshift_fuzz(15, 15);
     fftshift_fuzz(16, 15);
     fftshift_fuzz(15, 16);
+    auto spectrum_fuzz = [&](int w, int h, unsigned threads) {
+        const int cw = w / 2 + 1, stride = cw * 2;
+        vector<complex<double>> r(cw * h), g(cw * h), b(cw * h);
+        for (int i = 0; i < cw * h; i++) {
+            r[i] = {dist(mt), dist(mt)};
+            g[i] = {dist(mt), dist(mt)};
+            b[i] = {dist(mt), dist(mt)};
+        }
+        // the percentiles of the full mirrored plane, by sorting
+        vector<double> full;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const int i =
+                    x < cw ? y * cw + x : (h - y) % h * cw + (w - x);
+                full.push_back(0.2126 * norm(r[i]) + 0.7152 * norm(g[i]) +
+                               0.0722 * norm(b[i]));
+            }
+        }
+        auto expected = full;
+        sort(full.begin(), full.end());
+        const auto v0 = full[static_cast<int>(0.05 * (w * h - 1))];
+        const auto k = 1.0 / full[static_cast<int>(0.95 * (w * h - 1))];
+        vector<double> dr(stride * h), dg(stride * h), db(stride * h);
+        methods::spectrum(dr.data(), dg.data(), db.data(), stride, r.data(),
+            g.data(), b.data(), w, h, threads);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const auto v = k * (expected[y * w + x] - v0);
+                if (db[y * stride + x] != clamp(v, 0.0, 1.0) ||
+                    dg[y * stride + x] != clamp(v * 20, 0.0, 1.0)) {
+                    printf("spectrum fail on w=%d h=%d\n", w, h);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        // in place, over the real views of the spectra, as imageconv does
+        auto *const ir = reinterpret_cast<double *>(r.data());
+        auto *const ig = reinterpret_cast<double *>(g.data());
+        auto *const ib = reinterpret_cast<double *>(b.data());
+        methods::spectrum(ir, ig, ib, stride, r.data(), g.data(), b.data(),
+            w, h, threads);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const auto i = y * stride + x;
+                if (ir[i] != dr[i] || ig[i] != dg[i] || ib[i] != db[i]) {
+                    printf("spectrum in place fail on w=%d h=%d\n", w, h);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    };
+    spectrum_fuzz(16, 16, 1);
+    spectrum_fuzz(15, 17, 3);
+    spectrum_fuzz(64, 33, 4);
+    spectrum_fuzz(1, 5, 2);
+    auto downsample2x_fuzz = [&](int w, int h) {
+        const int n = (w / 2 + 1) * h, n1 = (w / 4 + 1) * (h / 2);
+        vector<complex<double>> a(n), k(n), k1(n1), expected(n1), got(n1);
+        for (int i = 0; i < n; i++) {
+            a[i] = {dist(mt), dist(mt)};
+            k[i] = {dist(mt), dist(mt)};
+        }
+        methods::downsample2x(k1.data(), k.data(), w, h);
+        methods::downsample2x(got.data(), a.data(), k1.data(), w, h);
+        methods::multiply(a.data(), k.data(), n);
+        methods::downsample2x(expected.data(), a.data(), w, h);
+        if (got != expected) {
+            printf("downsample2x fail on w=%d h=%d\n", w, h);
+            exit(EXIT_FAILURE);
+        }
+    };
+    downsample2x_fuzz(16, 16);
+    downsample2x_fuzz(20, 12);
+    downsample2x_fuzz(18, 14);
+    // resample against the 2x methods and against itself fused with k
+    auto resample_fuzz = [&](int w0, int h0, int w1, int h1) {
+        const int n0 = (w0 / 2 + 1) * h0, n1 = (w1 / 2 + 1) * h1;
+        vector<complex<double>> a(n0), k(n1), expected(n1), got(n1);
+        for (auto &it : a) { it = {dist(mt), dist(mt)}; }
+        for (auto &it : k) { it = {dist(mt), dist(mt)}; }
+        methods::resample(expected.data(), a.data(), w0, h0, w1, h1);
+        if (w1 * 2 == w0 && h1 * 2 == h0 && h1 % 2 == 0) {
+            methods::downsample2x(got.data(), a.data(), w0, h0);
+        } else if (w1 == w0 * 2 && h1 == h0 * 2 && h0 % 2 == 0) {
+            methods::upsample2x(got.data(), a.data(), w0, h0);
+        } else {
+            got = expected;
+        }
+        if (got != expected) {
+            printf("resample fail on %dx%d to %dx%d\n", w0, h0, w1, h1);
+            exit(EXIT_FAILURE);
+        }
+        methods::resample(got.data(), a.data(), k.data(), w0, h0, w1, h1);
+        methods::multiply(expected.data(), k.data(), n1);
+        if (got != expected) {
+            printf("resample fused fail on %dx%d to %dx%d\n", w0, h0, w1, h1);
+            exit(EXIT_FAILURE);
+        }
+        // without Nyquist frequencies, shifts add up and undo each other
+        if (w1 % 2 == 1 && h1 % 2 == 1) {
+            auto b = got;
+            methods::shift(got.data(), w1, h1, 0.25, -1.5);
+            methods::shift(got.data(), w1, h1, 0.5, 3.0);
+            methods::shift(b.data(), w1, h1, 0.75, 1.5);
+            methods::shift(got.data(), w1, h1, -0.75, -1.5);
+            methods::shift(b.data(), w1, h1, -0.75, -1.5);
+            for (int i = 0; i < n1; i++) {
+                if (abs(got[i] - expected[i]) > 1e-12 ||
+                    abs(b[i] - expected[i]) > 1e-12) {
+                    printf("shift fail on %dx%d\n", w1, h1);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    };
+    resample_fuzz(16, 16, 8, 8);
+    resample_fuzz(20, 12, 10, 6);
+    resample_fuzz(8, 6, 16, 12);
+    resample_fuzz(24, 16, 9, 5);
+    resample_fuzz(9, 7, 25, 15);
+    resample_fuzz(21, 35, 15, 11);
+    // the Hermitian half of the DFT of a real w x h plane, and back
+    const auto dft = [](const vector<double> &p, int w, int h) {
+        const int cw = w / 2 + 1;
+        vector<complex<double>> c(cw * h);
+        for (int v = 0; v < h; v++) {
+            for (int u = 0; u < cw; u++) {
+                for (int y = 0; y < h; y++) {
+                    for (int x = 0; x < w; x++) {
+                        c[v * cw + u] += p[y * w + x] *
+                            polar(1.0, -2 * M_PI *
+                                (double(u) * x / w + double(v) * y / h));
+                    }
+                }
+            }
+        }
+        return c;
+    };
+    const auto idft = [](const vector<complex<double>> &c, int w, int h) {
+        const int cw = w / 2 + 1;
+        vector<double> p(w * h);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                complex<double> sum;
+                for (int v = 0; v < h; v++) {
+                    for (int u = 0; u < w; u++) {
+                        const auto a = u < cw
+                            ? c[v * cw + u]
+                            : conj(c[(h - v) % h * cw + w - u]);
+                        sum += a * polar(1.0, 2 * M_PI *
+                            (double(u) * x / w + double(v) * y / h));
+                    }
+                }
+                p[y * w + x] = sum.real();
+            }
+        }
+        return p;
+    };
+    // upsampling n times keeps the input on every n-th sample, Nyquist
+    // included; n = 2 goes through upsample2x
+    auto upsample_check = [&](int w0, int h0, int n) {
+        const int w1 = w0 * n, h1 = h0 * n;
+        vector<double> p(w0 * h0);
+        for (int y = 0; y < h0; y++) {
+            for (int x = 0; x < w0; x++) {
+                p[y * w0 + x] = (x % 2 ? -1.0 : 1.0) + dist(mt) * 0.5;
+            }
+        }
+        auto c = dft(p, w0, h0);
+        vector<complex<double>> c1((w1 / 2 + 1) * h1);
+        if (n == 2) {
+            methods::upsample2x(c1.data(), c.data(), w0, h0);
+        } else {
+            methods::resample(c1.data(), c.data(), w0, h0, w1, h1);
+        }
+        const auto p1 = idft(c1, w1, h1);
+        for (int y = 0; y < h0; y++) {
+            for (int x = 0; x < w0; x++) {
+                const auto v = p1[y * n * w1 + x * n] / (w0 * h0);
+                if (abs(v - p[y * w0 + x]) > 1e-9) {
+                    printf("upsample fail on %dx%d times %d\n", w0, h0, n);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    };
+    upsample_check(8, 6, 2);
+    upsample_check(7, 4, 2);
+    upsample_check(8, 6, 3);
+    upsample_check(6, 7, 3);
+    upsample_check(5, 4, 3);
+    auto multiply_fuzz = [&](int n, int batch) {
+        vector<complex<double>> a(n * batch), k(n);
+        for (auto &it : a) { it = {dist(mt), dist(mt)}; }
+        for (auto &it : k) { it = {dist(mt), dist(mt)}; }
+        auto expected = a;
+        for (int j = 0; j < batch; j++) {
+            methods::multiply(expected.data() + j * n, k.data(), n);
+        }
+        methods::multiply(a.data(), k.data(), n, batch);
+        if (a != expected) {
+            printf("multiply fail on n=%d batch=%d\n", n, batch);
+            exit(EXIT_FAILURE);
+        }
+    };
+    multiply_fuzz(1, 1);
+    multiply_fuzz(153, 3);
+    multiply_fuzz(64, 4);
+    auto convolve_fuzz = [&](int w, int h, int radius, unsigned threads) {
+        const int stride = w + 3;
+        const auto mirror = [](int t, int n) {
+            while (t < 0 || t >= n) {
+                t = t < 0 ? -t : n * 2 - 1 - t;
+            }
+            return t;
+        };
+        vector<double> plane(stride * h), tmp(stride * h), k(radius + 1);
+        for (auto &it : plane) { it = dist(mt); }
+        for (auto &it : k) { it = dist(mt); }
+        auto expected = plane;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                double sum = 0;
+                for (int j = -radius; j <= radius; j++) {
+                    for (int i = -radius; i <= radius; i++) {
+                        sum += k[abs(i)] * k[abs(j)] *
+                               plane[mirror(y + j, h) * stride +
+                                     mirror(x + i, w)];
+                    }
+                }
+                expected[y * stride + x] = sum;
+            }
+        }
+        methods::convolve(
+            plane.data(), tmp.data(), w, h, stride, k.data(), radius, threads);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const auto i = y * stride + x;
+                if (abs(plane[i] - expected[i]) > 1e-9 * abs(expected[i])) {
+                    printf("convolve fail on w=%d h=%d radius=%d\n", w, h,
+                        radius);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    };
+    convolve_fuzz(16, 16, 3, 1);
+    convolve_fuzz(23, 9, 4, 3);
+    convolve_fuzz(5, 7, 12, 2);
+    convolve_fuzz(1, 1, 2, 1);
     return 0;
 }